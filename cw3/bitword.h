@@ -0,0 +1,215 @@
+#ifndef BITWORD_H
+#define BITWORD_H
+
+#include <cstdint>
+#include <type_traits>
+
+// Helpers for using unsigned integers as small fixed-size bitsets.  MultiWord
+// stands in for an unsigned integer when a bitset needs more than 64 bits.
+namespace BitWord {
+
+  // N 64 bit words that act like one 64*N bit unsigned integer.  Word 0 holds
+  // the lowest bits.
+  template <int N>
+  class MultiWord {
+   public:
+    MultiWord() { Fill(0); }
+    MultiWord(uint64_t low) {
+      Fill(0);
+      words_[0] = low;
+    }
+
+    uint64_t Word(int i) const { return words_[i]; }
+
+    explicit operator bool() const {
+      for (int i=0 ; i<N ; ++i) {
+        if (words_[i])
+          return true;
+      }
+      return false;
+    }
+
+    MultiWord operator ~() const {
+      MultiWord ret;
+      for (int i=0 ; i<N ; ++i)
+        ret.words_[i] = ~words_[i];
+      return ret;
+    }
+
+    MultiWord& operator &=(const MultiWord& other) {
+      for (int i=0 ; i<N ; ++i)
+        words_[i] &= other.words_[i];
+      return *this;
+    }
+    MultiWord& operator |=(const MultiWord& other) {
+      for (int i=0 ; i<N ; ++i)
+        words_[i] |= other.words_[i];
+      return *this;
+    }
+    MultiWord& operator ^=(const MultiWord& other) {
+      for (int i=0 ; i<N ; ++i)
+        words_[i] ^= other.words_[i];
+      return *this;
+    }
+
+    MultiWord& operator <<=(int shift) {
+      const int word_shift = shift / 64;
+      const int bit_shift = shift % 64;
+      for (int i=N-1 ; i>=0 ; --i) {
+        const int from = i - word_shift;
+        uint64_t word = 0;
+        if (from >= 0)
+          word = words_[from] << bit_shift;
+        if (from >= 1 && bit_shift)
+          word |= words_[from - 1] >> (64 - bit_shift);
+        words_[i] = word;
+      }
+      return *this;
+    }
+    MultiWord& operator >>=(int shift) {
+      const int word_shift = shift / 64;
+      const int bit_shift = shift % 64;
+      for (int i=0 ; i<N ; ++i) {
+        const int from = i + word_shift;
+        uint64_t word = 0;
+        if (from < N)
+          word = words_[from] >> bit_shift;
+        if (from < N-1 && bit_shift)
+          word |= words_[from + 1] << (64 - bit_shift);
+        words_[i] = word;
+      }
+      return *this;
+    }
+
+    // Defined as friends so plain integers convert to MultiWords
+    friend MultiWord operator &(MultiWord a, const MultiWord& b) { return a &= b; }
+    friend MultiWord operator |(MultiWord a, const MultiWord& b) { return a |= b; }
+    friend MultiWord operator ^(MultiWord a, const MultiWord& b) { return a ^= b; }
+    friend MultiWord operator <<(MultiWord a, int shift) { return a <<= shift; }
+    friend MultiWord operator >>(MultiWord a, int shift) { return a >>= shift; }
+
+    friend bool operator ==(const MultiWord& a, const MultiWord& b) {
+      for (int i=0 ; i<N ; ++i) {
+        if (a.words_[i] != b.words_[i])
+          return false;
+      }
+      return true;
+    }
+    friend bool operator !=(const MultiWord& a, const MultiWord& b) { return !(a == b); }
+
+   private:
+    void Fill(uint64_t value) {
+      for (int i=0 ; i<N ; ++i)
+        words_[i] = value;
+    }
+
+    uint64_t words_[N];
+  };
+
+  // The smallest word that holds the given number of bits
+  template <int Bits>
+  struct WordFor {
+    typedef typename std::conditional<Bits <= 16, uint16_t,
+            typename std::conditional<Bits <= 32, uint32_t,
+            typename std::conditional<Bits <= 64, uint64_t,
+                                      MultiWord<(Bits + 63) / 64> >::type>::type>::type Type;
+  };
+
+  inline int PopCount(uint16_t word) { return __builtin_popcount(word); }
+  inline int PopCount(uint32_t word) { return __builtin_popcount(word); }
+  inline int PopCount(uint64_t word) { return __builtin_popcountll(word); }
+  template <int N>
+  inline int PopCount(const MultiWord<N>& word) {
+    int ret = 0;
+    for (int i=0 ; i<N ; ++i)
+      ret += PopCount(word.Word(i));
+    return ret;
+  }
+
+  // The number of bits needed to hold the word, or the index of the highest
+  // set bit plus one.  Zero if no bits are set.
+  inline int BitLength(uint16_t word) { return word ? 32 - __builtin_clz(word) : 0; }
+  inline int BitLength(uint32_t word) { return word ? 32 - __builtin_clz(word) : 0; }
+  inline int BitLength(uint64_t word) { return word ? 64 - __builtin_clzll(word) : 0; }
+  template <int N>
+  inline int BitLength(const MultiWord<N>& word) {
+    for (int i=N-1 ; i>=0 ; --i) {
+      if (word.Word(i))
+        return i*64 + BitLength(word.Word(i));
+    }
+    return 0;
+  }
+
+  // The index of the lowest set bit.  The word must not be zero.
+  inline int LowestBit(uint16_t word) { return __builtin_ctz(word); }
+  inline int LowestBit(uint32_t word) { return __builtin_ctz(word); }
+  inline int LowestBit(uint64_t word) { return __builtin_ctzll(word); }
+  template <int N>
+  inline int LowestBit(const MultiWord<N>& word) {
+    int i = 0;
+    while (!word.Word(i))
+      ++i;
+    return i*64 + LowestBit(word.Word(i));
+  }
+
+  // The sum of the indices of all the set bits.  Bit k of each index is
+  // counted at once by masking the bits whose index has bit k set.
+  inline int WeightedPopCount(uint32_t word) {
+    return PopCount(uint32_t(word & 0xAAAAAAAAu)) +
+           (PopCount(uint32_t(word & 0xCCCCCCCCu)) << 1) +
+           (PopCount(uint32_t(word & 0xF0F0F0F0u)) << 2) +
+           (PopCount(uint32_t(word & 0xFF00FF00u)) << 3) +
+           (PopCount(uint32_t(word & 0xFFFF0000u)) << 4);
+  }
+  inline int WeightedPopCount(uint64_t word) {
+    return WeightedPopCount(uint32_t(word)) +
+           WeightedPopCount(uint32_t(word >> 32)) +
+           (PopCount(uint64_t(word & 0xFFFFFFFF00000000ull)) << 5);
+  }
+  template <int N>
+  inline int WeightedPopCount(const MultiWord<N>& word) {
+    int ret = 0;
+    for (int i=0 ; i<N ; ++i)
+      ret += WeightedPopCount(word.Word(i)) + i*64 * PopCount(word.Word(i));
+    return ret;
+  }
+
+  // A word with the lowest n bits set
+  template <typename T>
+  inline T LowBits(int n) {
+    const int bits = int(sizeof(T) * 8);
+    return n <= 0 ? T(0) : n >= bits ? T(~T(0)) : T(T(~T(0)) >> (bits - n));
+  }
+
+  // Removes the bits set in remove from word, moving the bits above each one
+  // down to fill the gap
+  template <typename T>
+  inline T Compact(T word, T remove) {
+    // Remove the highest bits first so the lower ones don't move
+    while (remove) {
+      const T below = LowBits<T>(BitLength(remove) - 1);
+      word = (word & below) | ((word >> 1) & ~below);
+      remove &= below;
+    }
+    return word;
+  }
+
+  // The opposite of Compact.  Inserts a zero bit at each position set in
+  // insert, moving the bits above it up.  The positions are the ones the bits
+  // will have in the result.
+  template <typename T>
+  inline T Expand(T word, T insert) {
+    // Insert the lowest bits first so the higher ones end up in the right place
+    while (insert) {
+      const int i = LowestBit(insert);
+      const T bit = T(1) << i;
+      const T below = LowBits<T>(i);
+      word = (word & below) | ((word << 1) & ~below & ~bit);
+      insert &= ~bit;
+    }
+    return word;
+  }
+
+} // namespace BitWord
+
+#endif // BITWORD_H
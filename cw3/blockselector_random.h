@@ -2,13 +2,18 @@
 #define BLOCKSELECTOR_RANDOM_H
 
 #include <tr1/array>
+#include <limits>
+#include <sstream>
 #include <boost/random/lagged_fibonacci.hpp>
 
+#include "tetramino.h"
+#include "utilities.h"
 #include "individualbase.h"
 #include "messages.pb.h"
 
 namespace BlockSelector {
 
+  template <typename PieceType = Tetramino>
   class Random : public IndividualBase {
    public:
     Random();
@@ -17,17 +22,107 @@ namespace BlockSelector {
     void Reset();
     int operator()();
 
+    // The number of pieces given out since Reset, and skipping to a
+    // position.  Seek replays every piece from the seed, so it takes as long
+    // as the position is.
+    uint64_t Position() const { return position_; }
+    void Seek(uint64_t position);
+
+    // Saves and restores the position with the generator's state, so a
+    // resumed game carries on straight away
+    void ToSnapshot(Messages::GameSnapshot* snapshot) const;
+    void FromSnapshot(const Messages::GameSnapshot& snapshot);
+
     // Individual
     void InitRandom();
 
+    // The seed the pieces come from, so a game can be handed out without
+    // copying the generator
+    uint32_t Seed() const { return seed_; }
+    void SetSeed(uint32_t seed);
+
     void ToMessage(Messages::BlockSelectorRandom* message);
     void FromMessage(const Messages::GameRequest& req);
 
    private:
     uint32_t seed_;
     boost::lagged_fibonacci607 rng_;
+    uint64_t position_;
   };
 
+
+  template <typename PieceType>
+  Random<PieceType>::Random()
+    : position_(0)
+  {
+  }
+
+  template <typename PieceType>
+  void Random<PieceType>::Reset() {
+    rng_.seed(seed_);
+    position_ = 0;
+  }
+
+  template <typename PieceType>
+  int Random<PieceType>::operator ()() {
+    // The pieces come from this selector's own generator, so the same seed
+    // always gives the same pieces.  They used to come from the global
+    // generator, so random games and fitnesses from older runs, like the
+    // ones in results/, can't be compared with these.
+    position_ ++;
+    return int(rng_() * PieceType::kTypeCount);
+  }
+
+  template <typename PieceType>
+  void Random<PieceType>::Seek(uint64_t position) {
+    Reset();
+    while (position_ < position)
+      (*this)();
+  }
+
+  template <typename PieceType>
+  void Random<PieceType>::ToSnapshot(Messages::GameSnapshot* snapshot) const {
+    std::ostringstream state;
+    state << rng_;
+    snapshot->set_selector_position(position_);
+    snapshot->set_selector_state(state.str());
+  }
+
+  template <typename PieceType>
+  void Random<PieceType>::FromSnapshot(const Messages::GameSnapshot& snapshot) {
+    if (!snapshot.has_selector_state()) {
+      Seek(snapshot.selector_position());
+      return;
+    }
+
+    std::istringstream state(snapshot.selector_state());
+    state >> rng_;
+    position_ = snapshot.selector_position();
+  }
+
+  template <typename PieceType>
+  void Random<PieceType>::InitRandom() {
+    seed_ = Utilities::global_rng() * std::numeric_limits<uint32_t>::max();
+    rng_.seed(seed_);
+  }
+
+  template <typename PieceType>
+  void Random<PieceType>::SetSeed(uint32_t seed) {
+    seed_ = seed;
+    rng_.seed(seed_);
+  }
+
+  template <typename PieceType>
+  void Random<PieceType>::ToMessage(Messages::BlockSelectorRandom* message) {
+    message->set_seed(seed_);
+  }
+
+  template <typename PieceType>
+  void Random<PieceType>::FromMessage(const Messages::GameRequest& req) {
+    seed_ = req.selector_random().seed();
+    rng_.seed(seed_);
+  }
+
 } // namespace BlockSelector
 
 #endif
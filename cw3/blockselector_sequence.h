@@ -17,7 +17,7 @@ DECLARE_bool(sonepoint);
 
 namespace BlockSelector {
 
-  template <int N = 1000000>
+  template <int N = 1000000, typename PieceType = Tetramino>
   class Sequence : public IndividualBase {
    public:
     Sequence();
@@ -33,6 +33,14 @@ namespace BlockSelector {
     void Reset();
     int operator()();
 
+    // The number of pieces given out since Reset, and skipping straight to
+    // a position, for resuming games
+    uint64_t Position() const { return position_; }
+    void Seek(uint64_t position);
+
+    void ToSnapshot(Messages::GameSnapshot* snapshot) const;
+    void FromSnapshot(const Messages::GameSnapshot& snapshot);
+
     // Individual
     void InitRandom();
     void MutateFrom(const Sequence& parent);
@@ -49,42 +57,61 @@ namespace BlockSelector {
    private:
     SequenceType sequence_;
     uint64_t next_index_;
+    uint64_t position_;
   };
 
 
-  template <int N>
-  Sequence<N>::Sequence()
-    : next_index_(0)
+  template <int N, typename PieceType>
+  Sequence<N, PieceType>::Sequence()
+    : next_index_(0),
+      position_(0)
   {
   }
 
-  template <int N>
-  int Sequence<N>::operator ()() {
+  template <int N, typename PieceType>
+  int Sequence<N, PieceType>::operator ()() {
     int ret = sequence_[next_index_];
     next_index_ = (next_index_ + 1) % N;
+    position_ ++;
 
     return ret;
   }
 
-  template <int N>
-  void Sequence<N>::InitRandom() {
+  template <int N, typename PieceType>
+  void Sequence<N, PieceType>::Seek(uint64_t position) {
+    next_index_ = position % N;
+    position_ = position;
+  }
+
+  template <int N, typename PieceType>
+  void Sequence<N, PieceType>::ToSnapshot(Messages::GameSnapshot* snapshot) const {
+    snapshot->set_selector_position(position_);
+  }
+
+  template <int N, typename PieceType>
+  void Sequence<N, PieceType>::FromSnapshot(const Messages::GameSnapshot& snapshot) {
+    Seek(snapshot.selector_position());
+  }
+
+  template <int N, typename PieceType>
+  void Sequence<N, PieceType>::InitRandom() {
     std::generate(sequence_.begin(), sequence_.end(),
-                  Tetramino::kTypeRange);
+                  PieceType::kTypeRange);
   }
 
-  template <int N>
-  void Sequence<N>::MutateFrom(const Sequence &parent) {
+  template <int N, typename PieceType>
+  void Sequence<N, PieceType>::MutateFrom(const Sequence &parent) {
     std::generate(sequence_.begin(), sequence_.end(), Utilities::MutateReplaceGenerator(
-                  FLAGS_smrate, Tetramino::kTypeRange, parent.sequence_.begin()));
+                  FLAGS_smrate, PieceType::kTypeRange, parent.sequence_.begin()));
   }
 
-  template <int N>
-  void Sequence<N>::CopyFrom(const Sequence &other) {
+  template <int N, typename PieceType>
+  void Sequence<N, PieceType>::CopyFrom(const Sequence &other) {
     sequence_ = other.sequence_;
   }
 
-  template <int N>
-  void Sequence<N>::Crossover(const Sequence &one, const Sequence &two) {
+  template <int N, typename PieceType>
+  void Sequence<N, PieceType>::Crossover(const Sequence &one, const Sequence &two) {
     if (FLAGS_sonepoint) {
       std::generate(sequence_.begin(), sequence_.end(),
           Utilities::OnePointCrossoverGenerator(
@@ -96,29 +123,30 @@ namespace BlockSelector {
     }
   }
 
-  template <int N>
-  void Sequence<N>::Mutate() {
+  template <int N, typename PieceType>
+  void Sequence<N, PieceType>::Mutate() {
     MutateFrom(*this);
   }
 
-  template <int N>
-  void Sequence<N>::Reset() {
+  template <int N, typename PieceType>
+  void Sequence<N, PieceType>::Reset() {
     next_index_ = 0;
+    position_ = 0;
   }
 
-  template <int N>
-  bool Sequence<N>::operator ==(const Sequence& other) const {
+  template <int N, typename PieceType>
+  bool Sequence<N, PieceType>::operator ==(const Sequence& other) const {
     return sequence_ == other.sequence_;
   }
 
-  template <int N>
-  void Sequence<N>::ToMessage(Messages::BlockSelectorSequence* message) {
+  template <int N, typename PieceType>
+  void Sequence<N, PieceType>::ToMessage(Messages::BlockSelectorSequence* message) {
     message->mutable_sequence()->resize(N);
     std::copy(sequence_.begin(), sequence_.end(), message->mutable_sequence()->begin());
   }
 
-  template <int N>
-  void Sequence<N>::FromMessage(const Messages::GameRequest& req) {
+  template <int N, typename PieceType>
+  void Sequence<N, PieceType>::FromMessage(const Messages::GameRequest& req) {
     std::copy(req.selector_sequence().sequence().begin(),
               req.selector_sequence().sequence().end(), sequence_.begin());
   }
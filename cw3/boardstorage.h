@@ -0,0 +1,505 @@
+#ifndef BOARDSTORAGE_H
+#define BOARDSTORAGE_H
+
+#include "tetramino.h"
+#include "bitword.h"
+
+#include <algorithm>
+#include <tr1/array>
+#include <type_traits>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+
+// Storage for the cells of a TetrisBoard.  Every storage type can give the
+// board's rows as bitmasks (bit x is set if the cell in column x is filled)
+// and its columns as bitmasks (bit i is set if the cell i rows up from the
+// bottom is filled).
+//
+// A width and height of 0 means the size is only known at runtime, up to
+// kMaxWidth x kMaxHeight.
+//
+// The words are the smallest unsigned integers that hold a row or column, or
+// BitWord::MultiWords for boards wider or taller than 64 cells.  Columns are
+// always at least 32 bits.
+namespace BoardStorage {
+
+  template <int W, int H>
+  struct Words {
+    static const int kMaxWidth = W ? W : 32;
+    static const int kMaxHeight = H ? H : 64;
+
+    typedef typename BitWord::WordFor<kMaxWidth>::Type RowType;
+    typedef typename BitWord::WordFor<(kMaxHeight > 32 ? kMaxHeight : 32)>::Type ColumnType;
+  };
+
+  // The size of the board.  A fixed size is a compile-time constant, so it
+  // folds away in all the shifts and masks that use it.
+  template <int W, int H>
+  class Dimensions {
+   public:
+    static int Width() { return W; }
+    static int Height() { return H; }
+
+    void SetSize(int width, int height) {
+      assert(width == W);
+      assert(height == H);
+      (void)width;
+      (void)height;
+    }
+  };
+
+  template <>
+  class Dimensions<0, 0> {
+   public:
+    Dimensions() : width_(0), height_(0) {}
+
+    int Width() const { return width_; }
+    int Height() const { return height_; }
+
+    void SetSize(int width, int height) {
+      assert(width > 0 && width <= (Words<0, 0>::kMaxWidth));
+      assert(height > 0 && height <= (Words<0, 0>::kMaxHeight));
+      width_ = width;
+      height_ = height;
+    }
+
+   private:
+    int width_;
+    int height_;
+  };
+
+  // Precomputed masks for every orientation of every piece in a set, built
+  // the first time they are used.  MasksType must be constructible from a
+  // piece and an orientation.
+  template <typename MasksType, typename PieceType>
+  class MaskTable {
+   public:
+    static const MasksType& Get(const PieceType& tetramino, int orientation) {
+      // Function-local statics are initialised in a thread-safe way
+      static const MaskTable table;
+      return table.masks_[tetramino.Type() * PieceType::kMaxOrientationCount + orientation];
+    }
+
+   private:
+    MaskTable() {
+      masks_.reserve(PieceType::kTypeCount * PieceType::kMaxOrientationCount);
+
+      PieceType tetramino;
+      for (int type=0 ; type<PieceType::kTypeCount ; ++type) {
+        tetramino.InitFrom(type);
+        for (int orientation=0 ; orientation<PieceType::kMaxOrientationCount ; ++orientation) {
+          if (orientation < tetramino.OrientationCount())
+            masks_.push_back(MasksType(tetramino, orientation));
+          else
+            masks_.push_back(MasksType());
+        }
+      }
+    }
+
+    std::vector<MasksType> masks_;
+  };
+
+
+  // One word for each row and one word for each column.  Works for any size
+  // of board, including ones sized at runtime.
+  template <int W, int H>
+  class Arrays : public Dimensions<W,H> {
+   public:
+    typedef typename Words<W,H>::RowType RowType;
+    typedef typename Words<W,H>::ColumnType ColumnType;
+
+    RowType Row(int y) const { return rows_[y]; }
+    ColumnType Column(int x) const { return columns_[x]; }
+    bool Cell(int x, int y) const { return bool(rows_[y] & (RowType(1) << x)); }
+
+    void Clear();
+    void Set(int x, int y, bool value);
+
+    template <typename PieceType>
+    void Add(const PieceType& tetramino, int x, int y, int orientation);
+    template <typename PieceType>
+    void Remove(const PieceType& tetramino, int x, int y, int orientation);
+    template <typename PieceType>
+    bool Collides(const PieceType& tetramino, int x, int y, int orientation) const;
+
+    // The rows that are completely filled, as a column mask
+    ColumnType FullRows() const;
+
+    // Removes the rows set in a column mask, moving the rows above them down
+    void RemoveRows(ColumnType rows);
+
+    // Undoes RemoveRows, putting full rows back where they were removed from.
+    // The rows pushed off the top must be empty.
+    void InsertFullRows(ColumnType rows);
+
+   private:
+    // A tetramino's cells with its top-left corner in the top-left corner of
+    // the board
+    template <typename PieceType>
+    struct Masks {
+      Masks() : width(0), height(0) {}
+      Masks(const PieceType& tetramino, int orientation);
+
+      int width;
+      int height;
+      RowType rows[PieceType::kBlockSize];
+      ColumnType columns[PieceType::kBlockSize];
+    };
+
+    template <typename PieceType>
+    static const Masks<PieceType>& GetMasks(const PieceType& tetramino, int orientation) {
+      return MaskTable<Masks<PieceType>, PieceType>::Get(tetramino, orientation);
+    }
+
+    static const int kMaxHeight = Words<W,H>::kMaxHeight;
+
+    ColumnType ColumnBit(int y) const {
+      return ColumnType(1) << (this->Height()-1 - y);
+    }
+
+    // Masks are built for a board kMaxHeight high, so they need moving down
+    // this much further on a shorter board
+    int ColumnShift(int y) const { return y + kMaxHeight - this->Height(); }
+
+    std::tr1::array<RowType, Words<W,H>::kMaxHeight> rows_;
+    std::tr1::array<ColumnType, Words<W,H>::kMaxWidth> columns_;
+  };
+
+
+  // The whole board packed into a single 64 or 128 bit integer, row-major,
+  // plus another one with the same cells column-major.  Placing a tetramino
+  // or testing for a collision is one shift and one bitwise operation, and
+  // copying the board is a couple of register moves.
+  template <int W, int H>
+  class Packed : public Dimensions<W,H> {
+   public:
+    typedef typename Words<W,H>::RowType RowType;
+    typedef typename Words<W,H>::ColumnType ColumnType;
+
+    static_assert(W*H <= 128, "Board is too big to pack into 128 bits");
+    typedef typename std::conditional<W*H <= 64, uint64_t, unsigned __int128>::type Word;
+
+    RowType Row(int y) const {
+      return RowType(rows_ >> (y*W)) & BitWord::LowBits<RowType>(W);
+    }
+    ColumnType Column(int x) const {
+      return ColumnType(columns_ >> (x*H)) & BitWord::LowBits<ColumnType>(H);
+    }
+    bool Cell(int x, int y) const { return (rows_ >> (y*W + x)) & 1; }
+
+    void Clear();
+    void Set(int x, int y, bool value);
+
+    template <typename PieceType>
+    void Add(const PieceType& tetramino, int x, int y, int orientation);
+    template <typename PieceType>
+    void Remove(const PieceType& tetramino, int x, int y, int orientation);
+    template <typename PieceType>
+    bool Collides(const PieceType& tetramino, int x, int y, int orientation) const;
+
+    // The rows that are completely filled, as a column mask
+    ColumnType FullRows() const;
+
+    // Removes the rows set in a column mask, moving the rows above them down
+    void RemoveRows(ColumnType rows);
+
+    // Undoes RemoveRows, putting full rows back where they were removed from.
+    // The rows pushed off the top must be empty.
+    void InsertFullRows(ColumnType rows);
+
+   private:
+    // A tetramino's cells with its top-left corner in the top-left corner of
+    // the board
+    template <typename PieceType>
+    struct Masks {
+      Masks() : rows(0), columns(0) {}
+      Masks(const PieceType& tetramino, int orientation);
+
+      Word rows;
+      Word columns;
+    };
+
+    template <typename PieceType>
+    static const Masks<PieceType>& GetMasks(const PieceType& tetramino, int orientation) {
+      return MaskTable<Masks<PieceType>, PieceType>::Get(tetramino, orientation);
+    }
+
+    // The bottom bit of every column
+    static Word ColumnBottoms();
+
+    // Removes row y and moves the rows above it down one
+    void RemoveRow(int y);
+
+    // Moves the rows above y up one and fills row y
+    void InsertFullRow(int y);
+
+    static ColumnType ColumnBit(int y) { return ColumnType(1) << (H-1 - y); }
+    static Word RowMask(int x, int y) { return Word(1) << (y*W + x); }
+    static Word ColumnMask(int x, int y) { return Word(1) << (x*H + H-1 - y); }
+
+    Word rows_;
+    Word columns_;
+  };
+
+
+  // Picks the packed storage for fixed size boards that fit in 128 bits
+  template <int W, int H>
+  struct Select {
+    typedef typename std::conditional<W && H && W*H <= 128 && W <= 64 && H <= 64,
+                                      Packed<W,H>, Arrays<W,H> >::type Type;
+  };
+
+
+  template <int W, int H>
+  template <typename PieceType>
+  Arrays<W,H>::Masks<PieceType>::Masks(const PieceType& tetramino, int orientation)
+      : width(tetramino.Size(orientation).width()),
+        height(tetramino.Size(orientation).height())
+  {
+    std::fill(rows, rows + PieceType::kBlockSize, 0);
+    std::fill(columns, columns + PieceType::kBlockSize, 0);
+
+    const Int2* point = tetramino.Points(orientation);
+    for (int i=0 ; i<tetramino.PointsCount() ; ++i) {
+      rows[point->y()] |= RowType(1) << point->x();
+      columns[point->x()] |= ColumnType(1) << (kMaxHeight-1 - point->y());
+      point++;
+    }
+  }
+
+  template <int W, int H>
+  void Arrays<W,H>::Clear() {
+    std::fill(rows_.begin(), rows_.end(), 0);
+    std::fill(columns_.begin(), columns_.end(), 0);
+  }
+
+  template <int W, int H>
+  void Arrays<W,H>::Set(int x, int y, bool value) {
+    if (value) {
+      rows_[y] |= RowType(1) << x;
+      columns_[x] |= ColumnBit(y);
+    } else {
+      rows_[y] &= ~(RowType(1) << x);
+      columns_[x] &= ~ColumnBit(y);
+    }
+  }
+
+  template <int W, int H>
+  template <typename PieceType>
+  void Arrays<W,H>::Add(const PieceType& tetramino, int x, int y, int orientation) {
+    const Masks<PieceType>& masks = GetMasks(tetramino, orientation);
+
+    for (int i=0 ; i<masks.height ; ++i) {
+      assert(!(rows_[y + i] & RowType(masks.rows[i] << x)));
+      rows_[y + i] |= masks.rows[i] << x;
+    }
+    for (int i=0 ; i<masks.width ; ++i) {
+      columns_[x + i] |= masks.columns[i] >> ColumnShift(y);
+    }
+  }
+
+  template <int W, int H>
+  template <typename PieceType>
+  void Arrays<W,H>::Remove(const PieceType& tetramino, int x, int y, int orientation) {
+    const Masks<PieceType>& masks = GetMasks(tetramino, orientation);
+
+    for (int i=0 ; i<masks.height ; ++i) {
+      rows_[y + i] &= ~RowType(masks.rows[i] << x);
+    }
+    for (int i=0 ; i<masks.width ; ++i) {
+      columns_[x + i] &= ~ColumnType(masks.columns[i] >> ColumnShift(y));
+    }
+  }
+
+  template <int W, int H>
+  template <typename PieceType>
+  bool Arrays<W,H>::Collides(const PieceType& tetramino, int x, int y, int orientation) const {
+    const Masks<PieceType>& masks = GetMasks(tetramino, orientation);
+
+    for (int i=0 ; i<masks.height ; ++i) {
+      if (rows_[y + i] & RowType(masks.rows[i] << x))
+        return true;
+    }
+    return false;
+  }
+
+  template <int W, int H>
+  typename Arrays<W,H>::ColumnType Arrays<W,H>::FullRows() const {
+    // A row is full if its bit is set in every column
+    ColumnType ret = BitWord::LowBits<ColumnType>(this->Height());
+    for (int x=0 ; x<this->Width() ; ++x) {
+      ret &= columns_[x];
+    }
+    return ret;
+  }
+
+  template <int W, int H>
+  void Arrays<W,H>::RemoveRows(ColumnType rows) {
+    // Move each row that's kept straight to its new place.  Rows below the
+    // lowest removed row stay where they are.
+    int to = this->Height()-1 - BitWord::LowestBit(rows);
+    for (int y=to ; y>=0 ; --y) {
+      if (rows & ColumnBit(y))
+        continue;
+      rows_[to--] = rows_[y];
+    }
+    std::fill(rows_.begin(), rows_.begin() + to + 1, 0);
+
+    for (int x=0 ; x<this->Width() ; ++x) {
+      columns_[x] = BitWord::Compact(columns_[x], rows);
+    }
+  }
+
+  template <int W, int H>
+  void Arrays<W,H>::InsertFullRows(ColumnType rows) {
+    // Walk down from the top, moving each kept row straight back to where it
+    // was.  The empty rows at the top are the ones pushed off the board, and
+    // rows below the lowest inserted row don't move.
+    const int last = this->Height()-1 - BitWord::LowestBit(rows);
+    int from = BitWord::PopCount(rows);
+    for (int y=0 ; y<=last ; ++y) {
+      if (rows & ColumnBit(y))
+        rows_[y] = BitWord::LowBits<RowType>(this->Width());
+      else
+        rows_[y] = rows_[from++];
+    }
+
+    const ColumnType column_mask = BitWord::LowBits<ColumnType>(this->Height());
+    for (int x=0 ; x<this->Width() ; ++x) {
+      columns_[x] = (BitWord::Expand(columns_[x], rows) | rows) & column_mask;
+    }
+  }
+
+
+  template <int W, int H>
+  template <typename PieceType>
+  Packed<W,H>::Masks<PieceType>::Masks(const PieceType& tetramino, int orientation)
+      : rows(0),
+        columns(0)
+  {
+    const Int2* point = tetramino.Points(orientation);
+    for (int i=0 ; i<tetramino.PointsCount() ; ++i) {
+      rows |= RowMask(point->x(), point->y());
+      columns |= ColumnMask(point->x(), point->y());
+      point++;
+    }
+  }
+
+  template <int W, int H>
+  typename Packed<W,H>::Word Packed<W,H>::ColumnBottoms() {
+    Word ret = 0;
+    for (int x=0 ; x<W ; ++x) {
+      ret |= Word(1) << (x*H);
+    }
+    return ret;
+  }
+
+  template <int W, int H>
+  void Packed<W,H>::Clear() {
+    rows_ = 0;
+    columns_ = 0;
+  }
+
+  template <int W, int H>
+  void Packed<W,H>::Set(int x, int y, bool value) {
+    if (value) {
+      rows_ |= RowMask(x, y);
+      columns_ |= ColumnMask(x, y);
+    } else {
+      rows_ &= ~RowMask(x, y);
+      columns_ &= ~ColumnMask(x, y);
+    }
+  }
+
+  template <int W, int H>
+  template <typename PieceType>
+  void Packed<W,H>::Add(const PieceType& tetramino, int x, int y, int orientation) {
+    const Masks<PieceType>& masks = GetMasks(tetramino, orientation);
+    const Word rows = masks.rows << (y*W + x);
+
+    assert(!(rows_ & rows));
+
+    // Moving down a row moves each column's bits right by one.  The tetramino
+    // always fits on the board so the bits never cross into the next column.
+    rows_ |= rows;
+    columns_ |= (masks.columns << (x*H)) >> y;
+  }
+
+  template <int W, int H>
+  template <typename PieceType>
+  void Packed<W,H>::Remove(const PieceType& tetramino, int x, int y, int orientation) {
+    const Masks<PieceType>& masks = GetMasks(tetramino, orientation);
+    rows_ &= ~(masks.rows << (y*W + x));
+    columns_ &= ~((masks.columns << (x*H)) >> y);
+  }
+
+  template <int W, int H>
+  template <typename PieceType>
+  bool Packed<W,H>::Collides(const PieceType& tetramino, int x, int y, int orientation) const {
+    const Masks<PieceType>& masks = GetMasks(tetramino, orientation);
+    return rows_ & (masks.rows << (y*W + x));
+  }
+
+  template <int W, int H>
+  typename Packed<W,H>::ColumnType Packed<W,H>::FullRows() const {
+    // A row is full if its bit is set in every column
+    ColumnType ret = BitWord::LowBits<ColumnType>(H);
+    for (int x=0 ; x<W ; ++x) {
+      ret &= Column(x);
+    }
+    return ret;
+  }
+
+  template <int W, int H>
+  void Packed<W,H>::RemoveRows(ColumnType rows) {
+    // Remove the highest rows first so the lower ones don't move
+    while (rows) {
+      const int i = BitWord::BitLength(rows) - 1;
+      RemoveRow(H-1 - i);
+      rows &= ~(ColumnType(1) << i);
+    }
+  }
+
+  template <int W, int H>
+  void Packed<W,H>::InsertFullRows(ColumnType rows) {
+    // Insert the lowest rows first so the higher ones end up in the right place
+    while (rows) {
+      const int i = BitWord::LowestBit(rows);
+      InsertFullRow(H-1 - i);
+      rows &= rows - 1;
+    }
+  }
+
+  template <int W, int H>
+  void Packed<W,H>::RemoveRow(int y) {
+    // Rows above y move up by one row's worth of bits
+    rows_ = ((rows_ & BitWord::LowBits<Word>(y*W)) << W) |
+            (rows_ & ~BitWord::LowBits<Word>((y+1)*W));
+
+    // In every column keep the bits below the row, and move the ones above it
+    // down by one
+    const ColumnType below = ColumnBit(y) - 1;
+    const ColumnType above = BitWord::LowBits<ColumnType>(H-1) & ~below;
+    columns_ = (columns_ & (ColumnBottoms() * below)) |
+               ((columns_ >> 1) & (ColumnBottoms() * above));
+  }
+
+  template <int W, int H>
+  void Packed<W,H>::InsertFullRow(int y) {
+    // The top row is pushed off the board
+    rows_ = ((rows_ >> W) & BitWord::LowBits<Word>(y*W)) |
+            (BitWord::LowBits<Word>(W) << (y*W)) |
+            (rows_ & ~BitWord::LowBits<Word>((y+1)*W));
+
+    const ColumnType bit = ColumnBit(y);
+    const ColumnType below = bit - 1;
+    const ColumnType above = BitWord::LowBits<ColumnType>(H) & ~below & ~bit;
+    columns_ = (columns_ & (ColumnBottoms() * below)) |
+               ((columns_ << 1) & (ColumnBottoms() * above)) |
+               (ColumnBottoms() * bit);
+  }
+
+} // namespace BoardStorage
+
+#endif // BOARDSTORAGE_H
@@ -5,8 +5,6 @@ TARGET = cw3
 TEMPLATE = app
 SOURCES += main.cpp \
     individual.cpp \
-    tetramino.cpp \
-    blockselector_random.cpp \
     blockselector_sequence.cpp \
     individualbase.cpp \
     gamemapper.cpp \
@@ -15,6 +13,7 @@ SOURCES += main.cpp \
 HEADERS += individual.h \
     tetrisboard.h \
     tetramino.h \
+    pieceset.h \
     game.h \
     engine.h \
     population.h \
@@ -22,7 +21,15 @@ HEADERS += individual.h \
     blockselector_random.h \
     blockselector_sequence.h \
     individualbase.h \
-    gamemapper.h
+    gamemapper.h \
+    bitword.h \
+    boardstorage.h \
+    placementtable.h \
+    directmappedtable.h \
+    transpositiontable.h \
+    ratingcache.h \
+    scheduler.h \
+    survivalestimator.h
 PROTOBUF_SOURCES += messages.proto
 
 CONFIG(release):DEFINES += NDEBUG # For cassert
@@ -32,10 +39,12 @@ CONFIG(debug, debug|release) {
     QT += testlib
     SOURCES += test_board.cpp \
         test_tetramino.cpp \
-        test_generators.cpp
+        test_generators.cpp \
+        test_game.cpp
     HEADERS += test_board.h \
         test_tetramino.h \
-        test_generators.h
+        test_generators.h \
+        test_game.h
     QMAKE_POST_LINK = ./cw3 \
         t
 }
@@ -48,7 +57,7 @@ CONFIG(debug, debug|release) {
 
 # google-gflags
 LIBS += -lgflags
-QMAKE_CXXFLAGS += --std=c++0x
+QMAKE_CXXFLAGS += --std=c++14
 
 # protobuf
 protobuf_cpp.input = PROTOBUF_SOURCES
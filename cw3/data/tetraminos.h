@@ -0,0 +1,126 @@
+// Tetramino shapes, read from tetraminos.png.  test_tetramino.cpp checks that
+// these tables still match the image.  Unused orientations are left zeroed.
+// Included by pieceset.h after TetraminoSet is declared.
+
+namespace TetraminoData {
+
+constexpr int kOrientationCount[TetraminoSet::kTypeCount] = {
+  2, 4, 4, 1, 2, 4, 2
+};
+
+constexpr Int2 kPoints[TetraminoSet::kTypeCount][TetraminoSet::kMaxOrientationCount][TetraminoSet::kMaxPointsCount] = {
+  { // I
+    { {0, 0}, {1, 0}, {2, 0}, {3, 0} },
+    { {0, 0}, {0, 1}, {0, 2}, {0, 3} },
+    { {0, 0}, {0, 0}, {0, 0}, {0, 0} },
+    { {0, 0}, {0, 0}, {0, 0}, {0, 0} }
+  },
+  { // J
+    { {0, 0}, {0, 1}, {1, 1}, {2, 1} },
+    { {0, 0}, {0, 1}, {0, 2}, {1, 0} },
+    { {0, 0}, {1, 0}, {2, 0}, {2, 1} },
+    { {0, 2}, {1, 0}, {1, 1}, {1, 2} }
+  },
+  { // L
+    { {0, 1}, {1, 1}, {2, 0}, {2, 1} },
+    { {0, 0}, {0, 1}, {0, 2}, {1, 2} },
+    { {0, 0}, {0, 1}, {1, 0}, {2, 0} },
+    { {0, 0}, {1, 0}, {1, 1}, {1, 2} }
+  },
+  { // O
+    { {0, 0}, {0, 1}, {1, 0}, {1, 1} },
+    { {0, 0}, {0, 0}, {0, 0}, {0, 0} },
+    { {0, 0}, {0, 0}, {0, 0}, {0, 0} },
+    { {0, 0}, {0, 0}, {0, 0}, {0, 0} }
+  },
+  { // S
+    { {0, 1}, {1, 0}, {1, 1}, {2, 0} },
+    { {0, 0}, {0, 1}, {1, 1}, {1, 2} },
+    { {0, 0}, {0, 0}, {0, 0}, {0, 0} },
+    { {0, 0}, {0, 0}, {0, 0}, {0, 0} }
+  },
+  { // T
+    { {0, 1}, {1, 0}, {1, 1}, {2, 1} },
+    { {0, 0}, {0, 1}, {0, 2}, {1, 1} },
+    { {0, 0}, {1, 0}, {1, 1}, {2, 0} },
+    { {0, 1}, {1, 0}, {1, 1}, {1, 2} }
+  },
+  { // Z
+    { {0, 0}, {1, 0}, {1, 1}, {2, 1} },
+    { {0, 1}, {0, 2}, {1, 0}, {1, 1} },
+    { {0, 0}, {0, 0}, {0, 0}, {0, 0} },
+    { {0, 0}, {0, 0}, {0, 0}, {0, 0} }
+  }
+};
+
+constexpr Int2 kSize[TetraminoSet::kTypeCount][TetraminoSet::kMaxOrientationCount] = {
+  { {4, 1}, {1, 4}, {0, 0}, {0, 0} }, // I
+  { {3, 2}, {2, 3}, {3, 2}, {2, 3} }, // J
+  { {3, 2}, {2, 3}, {3, 2}, {2, 3} }, // L
+  { {2, 2}, {0, 0}, {0, 0}, {0, 0} }, // O
+  { {3, 2}, {2, 3}, {0, 0}, {0, 0} }, // S
+  { {3, 2}, {2, 3}, {3, 2}, {2, 3} }, // T
+  { {3, 2}, {2, 3}, {0, 0}, {0, 0} }  // Z
+};
+
+constexpr int kBottom[TetraminoSet::kTypeCount][TetraminoSet::kMaxOrientationCount][TetraminoSet::kBlockSize] = {
+  { // I
+    {  0,  0,  0,  0 },
+    {  3, -1, -1, -1 },
+    {  0,  0,  0,  0 },
+    {  0,  0,  0,  0 }
+  },
+  { // J
+    {  1,  1,  1, -1 },
+    {  2,  0, -1, -1 },
+    {  0,  0,  1, -1 },
+    {  2,  2, -1, -1 }
+  },
+  { // L
+    {  1,  1,  1, -1 },
+    {  2,  2, -1, -1 },
+    {  1,  0,  0, -1 },
+    {  0,  2, -1, -1 }
+  },
+  { // O
+    {  1,  1, -1, -1 },
+    {  0,  0,  0,  0 },
+    {  0,  0,  0,  0 },
+    {  0,  0,  0,  0 }
+  },
+  { // S
+    {  1,  1,  0, -1 },
+    {  1,  2, -1, -1 },
+    {  0,  0,  0,  0 },
+    {  0,  0,  0,  0 }
+  },
+  { // T
+    {  1,  1,  1, -1 },
+    {  2,  1, -1, -1 },
+    {  0,  1,  0, -1 },
+    {  1,  2, -1, -1 }
+  },
+  { // Z
+    {  0,  1,  1, -1 },
+    {  2,  1, -1, -1 },
+    {  0,  0,  0,  0 },
+    {  0,  0,  0,  0 }
+  }
+};
+
+// The type and orientations of each tetramino reflected left to right
+constexpr int kMirrorType[TetraminoSet::kTypeCount] = {
+  0, 2, 1, 3, 6, 5, 4
+};
+
+constexpr int kMirrorOrientation[TetraminoSet::kTypeCount][TetraminoSet::kMaxOrientationCount] = {
+  {  0,  1,  0,  0 }, // I
+  {  0,  3,  2,  1 }, // J
+  {  0,  3,  2,  1 }, // L
+  {  0,  0,  0,  0 }, // O
+  {  0,  1,  0,  0 }, // S
+  {  0,  3,  2,  1 }, // T
+  {  0,  1,  0,  0 }  // Z
+};
+
+} // namespace TetraminoData
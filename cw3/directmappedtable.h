@@ -0,0 +1,82 @@
+#ifndef DIRECTMAPPEDTABLE_H
+#define DIRECTMAPPEDTABLE_H
+
+#include <vector>
+#include <cstdint>
+
+// A hash table with a fixed number of slots, indexed by the low bits of the
+// key.  A new entry replaces whatever was in its slot.  The keys are
+// expected to be Zobrist hashes, so the low bits are as good as any.
+template <typename Value>
+class DirectMappedTable {
+ public:
+  DirectMappedTable() : mask_(0) {}
+
+  // Rounded up to a power of 2.  Zero disables the table.
+  void SetSize(int size);
+  bool Enabled() const { return !entries_.empty(); }
+
+  // The value stored for key, or NULL if it isn't there
+  const Value* Find(uint64_t key) const;
+  void Insert(uint64_t key, const Value& value);
+
+  // Calls function(key, value) for every entry.  Inserting them all into an
+  // empty table of the same size gives the same table.
+  template <typename Function>
+  void ForEach(Function function) const;
+
+ private:
+  struct Entry {
+    Entry() : key(0), value(), used(false) {}
+
+    uint64_t key;
+    Value value;
+    bool used;
+  };
+
+  std::vector<Entry> entries_;
+  uint64_t mask_;
+};
+
+template <typename Value>
+void DirectMappedTable<Value>::SetSize(int size) {
+  entries_.clear();
+  mask_ = 0;
+
+  if (size <= 0)
+    return;
+
+  int rounded = 1;
+  while (rounded < size)
+    rounded *= 2;
+
+  entries_.resize(rounded);
+  mask_ = rounded - 1;
+}
+
+template <typename Value>
+inline const Value* DirectMappedTable<Value>::Find(uint64_t key) const {
+  const Entry& entry = entries_[key & mask_];
+  if (!entry.used || entry.key != key)
+    return NULL;
+  return &entry.value;
+}
+
+template <typename Value>
+inline void DirectMappedTable<Value>::Insert(uint64_t key, const Value& value) {
+  Entry& entry = entries_[key & mask_];
+  entry.key = key;
+  entry.value = value;
+  entry.used = true;
+}
+
+template <typename Value>
+template <typename Function>
+void DirectMappedTable<Value>::ForEach(Function function) const {
+  for (auto it = entries_.begin() ; it != entries_.end() ; ++it) {
+    if (it->used)
+      function(it->key, it->value);
+  }
+}
+
+#endif // DIRECTMAPPEDTABLE_H
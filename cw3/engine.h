@@ -6,11 +6,12 @@
 #include "individual.h"
 #include "blockselector_sequence.h"
 #include "blockselector_random.h"
-#include "gamemapper.h"
+#include "scheduler.h"
 
 #include <QtConcurrentMap>
 
 #include <iostream>
+#include <sstream>
 #include <gflags/gflags.h>
 #include <boost/bind.hpp>
 #include <sys/time.h>
@@ -24,32 +25,80 @@ DEFINE_bool(dumpseq, false, "dump the best tetramino sequence after each generat
 DEFINE_bool(watchseq, false, "watch the best tetramino sequence after each generation");
 DEFINE_int32(watchseqdelay, 10, "delay between each move in milliseconds");
 
+DEFINE_bool(bench, false, "time games at each -benchsearch lookahead setting instead of evolving");
+DEFINE_string(benchsearch, "1:0,2:0,p,3:8,3:32,4:8,e", "comma separated depth:beam settings for -bench, or p for pruned two-ply or e for expectimax");
+
 DECLARE_uint64(stopafter);
+DECLARE_uint64(censorafter);
+DECLARE_int32(censorwindow);
+DECLARE_double(censorinterval);
+DECLARE_uint64(parallelafter);
 DECLARE_double(smrate);
 DECLARE_bool(sonepoint);
 DECLARE_double(pmrate);
 DECLARE_double(pwmstddev);
 DECLARE_double(pemstddev);
 DECLARE_double(pdmstddev);
+DECLARE_int32(depth);
+DECLARE_int32(beam);
+DECLARE_bool(expectimax);
 
 template <typename PlayerType, typename BoardType>
 class Engine {
  public:
-  Engine();
+  Engine(int board_width, int board_height);
 
-  typedef BlockSelector::Sequence<> SelectorType;
+  typedef typename BoardType::PieceType PieceType;
+  typedef BlockSelector::Sequence<1000000, PieceType> SelectorType;
+  typedef BlockSelector::Random<PieceType> RandomSelectorType;
   typedef Game<PlayerType, SelectorType, BoardType> GameType;
-  typedef Game<PlayerType, BlockSelector::Random, BoardType> RandomGameType;
+  typedef Game<PlayerType, RandomSelectorType, BoardType> RandomGameType;
 
   void Run();
 
+  // Plays the same games with each lookahead setting in -benchsearch and
+  // prints how many blocks per second each one managed
+  void Benchmark();
+
  private:
+  // A game for UpdateFitness to play.  It points straight at the player and
+  // sequence in the populations, which don't change while the games run, so
+  // handing it to a thread copies nothing.  Games that leave the process go
+  // through GameMapper and protobuf instead.
+  struct GameJob {
+    int player_id;
+    int selector_id;
+    const PlayerType* player;
+    SelectorType* sequence;  // NULL to play random pieces from seed
+    uint32_t seed;
+    int board_width;
+    int board_height;
+  };
+
+  struct GameResult {
+    int player_id;
+    int selector_id;
+    uint64_t fitness;
+    bool censored;
+  };
+
+  GameJob MakeJob(int player_id, int selector_id, SelectorType* sequence) const;
+  static GameResult PlayGame(const GameJob& job);
+
   void UpdateFitness();
   static const PlayerType& FittestOf(const PlayerType& one, const PlayerType& two);
 
+  int board_width_;
+  int board_height_;
+
   Population<PlayerType> player_pop_;
   Population<SelectorType> selector_pop_;
 
+  // Runs each generation's games, and how busy it kept the threads
+  Scheduler<GameJob, GameResult> scheduler_;
+  uint64_t busy_usec_;
+  uint64_t capacity_usec_;
+
   // Functor for using QtConcurrentMap with object pointers
   template <typename T, typename C>
   class PointerMemberFunctionWrapper
@@ -71,9 +120,14 @@ class Engine {
 };
 
 template <typename PlayerType, typename BoardType>
-Engine<PlayerType, BoardType>::Engine()
-    : player_pop_(FLAGS_pop),
-      selector_pop_(FLAGS_pop)
+Engine<PlayerType, BoardType>::Engine(int board_width, int board_height)
+    : board_width_(board_width),
+      board_height_(board_height),
+      player_pop_(FLAGS_pop),
+      selector_pop_(FLAGS_pop),
+      scheduler_(FLAGS_threads),
+      busy_usec_(0),
+      capacity_usec_(0)
 {
 }
 
@@ -99,7 +153,14 @@ void Engine<PlayerType, BoardType>::Run() {
   cout << "# Games: " << FLAGS_games << endl;
   if (FLAGS_stopafter)
     cout << "# Stopping after: " << FLAGS_stopafter << " blocks" << endl;
-  cout << "# Board size: " << BoardType::kWidth << "x" << BoardType::kHeight << endl;
+  if (FLAGS_censorafter)
+    cout << "# Censoring after: " << FLAGS_censorafter << " blocks (window "
+         << FLAGS_censorwindow << ", interval " << FLAGS_censorinterval << ")" << endl;
+  cout << "# Board size: " << board_width_ << "x" << board_height_;
+  if (!BoardType::kWidth)
+    cout << " (sized at runtime)";
+  cout << endl;
+  cout << "# Pieces: " << Messages::BoardType::Pieces_Name(PieceType::PieceSet::kMessageType) << endl;
   cout << "# Mutation std dev (player weights): " << FLAGS_pwmstddev << endl;
   if (PlayerType::HasExponents())
     cout << "# Mutation std dev (player exponents): " << FLAGS_pemstddev << endl;
@@ -111,7 +172,13 @@ void Engine<PlayerType, BoardType>::Run() {
   cout << "# Block selector crossover: " << (FLAGS_sonepoint ? "One-point" : "Uniform") << endl;
   cout << "# Generations: " << FLAGS_generations << endl;
   cout << "# Threads: " << FLAGS_threads << endl;
+  if (FLAGS_parallelafter)
+    cout << "# Parallel search after: " << FLAGS_parallelafter << " blocks" << endl;
   cout << "# Board rating function: " << PlayerType::NameOfAlgorithm() << endl;
+  if (FLAGS_expectimax)
+    cout << "# Lookahead: expectimax over the next piece" << endl;
+  else
+    cout << "# Lookahead: depth " << FLAGS_depth << ", beam " << FLAGS_beam << endl;
 
 #ifndef QT_NO_DEBUG
   cout << "# Running in debug mode with assertions enabled" << endl;
@@ -143,6 +210,9 @@ void Engine<PlayerType, BoardType>::Run() {
     cout << "\tsd-e";
   if (PlayerType::HasDisplacements())
     cout << "\tsd-d";
+  cout << "\tBalance";
+  if (FLAGS_censorafter)
+    cout << "\tCensored";
   cout << endl;
 
   cout.precision(3);
@@ -186,6 +256,9 @@ void Engine<PlayerType, BoardType>::Run() {
       cout << "\t" << player_pop_.Diversity(boost::bind(&PlayerType::Exponents, _1));
     if (PlayerType::HasDisplacements())
       cout << "\t" << player_pop_.Diversity(boost::bind(&PlayerType::Displacements, _1));
+    cout << "\t" << (capacity_usec_ ? double(busy_usec_) / capacity_usec_ : 1.0);
+    if (FLAGS_censorafter)
+      cout << "\t" << player_pop_.CensoredCount();
     cout << endl;
 
     // Make new populations
@@ -197,83 +270,213 @@ void Engine<PlayerType, BoardType>::Run() {
 }
 
 template <typename PlayerType, typename BoardType>
-void Engine<PlayerType, BoardType>::UpdateFitness() {
-  // Create games
-  std::vector<Messages::GameRequest> requests;
-  requests.reserve(FLAGS_pop);
+void Engine<PlayerType, BoardType>::Benchmark() {
+  using std::cout;
+  using std::endl;
 
-  for (int i = 0 ; i < FLAGS_pop ; ++i) {
-    Messages::GameRequest req;
-    req.set_player_id(i);
-    req.set_selector_id(i);
-    player_pop_[i].ToMessage(req.mutable_player());
-    BoardType::ToMessage(req.mutable_board());
+  struct Setting {
+    int depth;
+    int beam;
+    bool expectimax;
+    bool prune;
+  };
 
-    if (FLAGS_games)
-      selector_pop_[i].ToMessage(req.mutable_selector_sequence());
-    else {
-      BlockSelector::Random random;
-      random.InitRandom();
-      random.ToMessage(req.mutable_selector_random());
+  // Parse the settings first so a typo doesn't waste a run
+  std::vector<Setting> settings;
+  std::istringstream settings_stream(FLAGS_benchsearch);
+  std::string text;
+  while (std::getline(settings_stream, text, ',')) {
+    Setting setting = {2, 0, text == "e", text == "p"};
+    char trailing;
+    if (!setting.expectimax && !setting.prune &&
+        (sscanf(text.c_str(), "%d:%d%c", &setting.depth, &setting.beam, &trailing) != 2 ||
+         setting.depth < 1 || setting.depth > kMaxLookaheadDepth || setting.beam < 0)) {
+      std::cerr << "Lookahead settings should look like 3:16, p or e, not " << text << std::endl;
+      return;
     }
+    settings.push_back(setting);
+  }
+
+  // Every setting plays the same players against the same sequences
+  player_pop_.InitRandom();
 
-    requests.push_back(req);
+  std::vector<uint32_t> seeds(FLAGS_pop);
+  for (int i = 0 ; i < FLAGS_pop ; ++i) {
+    RandomSelectorType random;
+    random.InitRandom();
+    seeds[i] = random.Seed();
   }
 
-  if (requests.size() == 0)
-    return;
+  cout << "# Games per setting: " << FLAGS_pop << endl;
+  if (FLAGS_stopafter)
+    cout << "# Stopping after: " << FLAGS_stopafter << " blocks" << endl;
+  cout << "# Board size: " << board_width_ << "x" << board_height_ << endl;
+  cout << "# Pieces: " << Messages::BoardType::Pieces_Name(PieceType::PieceSet::kMessageType) << endl;
+  cout << "# Board rating function: " << PlayerType::NameOfAlgorithm() << endl;
+  cout << endl;
+  cout << "Depth\t"
+          "Beam\t"
+          "Blocks\t"
+          "Time\t"
+          "Blocks/s\t"
+          "Pruned" << endl;
+
+  for (auto it = settings.begin() ; it != settings.end() ; ++it) {
+    timeval start_time, end_time;
+    uint64_t blocks = 0;
+    uint64_t subtrees_searched = 0;
+    uint64_t subtrees_pruned = 0;
 
-  // Run games
-  QFuture<Messages::GameResponse> future = QtConcurrent::mapped(
-      requests, boost::bind(&GameMapper::Map, _1));
-  future.waitForFinished();
-  QList<Messages::GameResponse> responses = future.results();
+    // One thread, so the numbers are for the search rather than the machine
+    gettimeofday(&start_time, NULL);
+    for (int i = 0 ; i < FLAGS_pop ; ++i) {
+      RandomSelectorType selector;
+      selector.SetSeed(seeds[i]);
+
+      RandomGameType game(player_pop_[i], selector);
+      game.SetBoardSize(board_width_, board_height_);
+      game.SetLookahead(it->depth, it->beam);
+      game.SetExpectimax(it->expectimax);
+      game.SetPruning(it->prune);
+      game.SetParallelAfter(0);
+      game.Play();
+      blocks += game.BlocksPlaced();
+      subtrees_searched += game.SubtreesSearched();
+      subtrees_pruned += game.SubtreesPruned();
+    }
+    gettimeofday(&end_time, NULL);
 
-  // Update the fitness for each player
-  // And prepare more games for each player against random sequences
-  requests.clear();
+    uint64_t time_taken = (end_time.tv_sec - start_time.tv_sec) * 1000000 +
+                           end_time.tv_usec - start_time.tv_usec;
+    time_taken /= 1000; // msec
 
-  if (FLAGS_games)
-    requests.reserve(FLAGS_pop * FLAGS_games);
+    if (it->expectimax)
+      cout << "e\t-\t";
+    else if (it->prune)
+      cout << "p\t-\t";
+    else
+      cout << it->depth << "\t" << it->beam << "\t";
+    cout << blocks << "\t" <<
+            time_taken << "\t" <<
+            uint64_t(blocks * 1000.0 / std::max<uint64_t>(time_taken, 1)) << "\t";
+
+    // The percentage of second plies that were skipped
+    if (it->prune) {
+      cout << 100.0 * subtrees_pruned /
+              std::max<uint64_t>(subtrees_searched + subtrees_pruned, 1) << "%";
+    } else {
+      cout << "-";
+    }
+    cout << endl;
+  }
+}
 
-  for (auto it = responses.begin() ; it != responses.end() ; ++it) {
-    const Messages::GameResponse& resp = *it;
+template <typename PlayerType, typename BoardType>
+typename Engine<PlayerType, BoardType>::GameJob Engine<PlayerType, BoardType>::MakeJob(
+    int player_id, int selector_id, SelectorType* sequence) const {
+  GameJob job;
+  job.player_id = player_id;
+  job.selector_id = selector_id;
+  job.player = &player_pop_[player_id];
+  job.sequence = sequence;
+  job.seed = 0;
+  job.board_width = board_width_;
+  job.board_height = board_height_;
+
+  if (!sequence) {
+    RandomSelectorType random;
+    random.InitRandom();
+    job.seed = random.Seed();
+  }
+  return job;
+}
 
-    player_pop_[resp.player_id()].SetFitness(resp.blocks_placed());
+template <typename PlayerType, typename BoardType>
+typename Engine<PlayerType, BoardType>::GameResult Engine<PlayerType, BoardType>::PlayGame(
+    const GameJob& job) {
+  GameResult result;
+  result.player_id = job.player_id;
+  result.selector_id = job.selector_id;
+
+  if (job.sequence) {
+    GameType game(*job.player, *job.sequence);
+    game.SetBoardSize(job.board_width, job.board_height);
+    game.Play();
+    result.fitness = game.Fitness();
+    result.censored = game.Censored();
+  } else {
+    RandomSelectorType random;
+    random.SetSeed(job.seed);
+
+    RandomGameType game(*job.player, random);
+    game.SetBoardSize(job.board_width, job.board_height);
+    game.Play();
+    result.fitness = game.Fitness();
+    result.censored = game.Censored();
+  }
+  return result;
+}
 
-    for (int i=0 ; i<FLAGS_games ; ++i) {
-      Messages::GameRequest req;
-      req.set_player_id(resp.player_id());
-      req.set_selector_id(resp.selector_id());
-      player_pop_[resp.player_id()].ToMessage(req.mutable_player());
-      BoardType::ToMessage(req.mutable_board());
+template <typename PlayerType, typename BoardType>
+void Engine<PlayerType, BoardType>::UpdateFitness() {
+  busy_usec_ = 0;
+  capacity_usec_ = 0;
+
+  // Create games.  Each player's random games only need its genes, not the
+  // result of its sequence game, so they all go in one batch and nothing
+  // waits for the slowest sequence game before starting.  Children of long
+  // lived parents will probably live long too, so their games are started
+  // first.  Each sequence is only played by its own player, so the games can
+  // all use the population's copy.  The sequence games are the first
+  // FLAGS_pop jobs, and player i's random games are the FLAGS_games after
+  // FLAGS_pop + i * FLAGS_games.
+  std::vector<GameJob> jobs;
+  std::vector<uint64_t> costs;
+  jobs.reserve(FLAGS_pop * (1 + FLAGS_games));
 
-      BlockSelector::Random random;
-      random.InitRandom();
-      random.ToMessage(req.mutable_selector_random());
+  for (int i = 0 ; i < FLAGS_pop ; ++i) {
+    jobs.push_back(MakeJob(i, i, FLAGS_games ? &selector_pop_[i] : NULL));
+    costs.push_back(player_pop_[i].ExpectedFitness());
+  }
 
-      requests.push_back(req);
+  for (int i = 0 ; i < FLAGS_pop ; ++i) {
+    for (int j = 0 ; j < FLAGS_games ; ++j) {
+      jobs.push_back(MakeJob(i, i, NULL));
+      costs.push_back(player_pop_[i].ExpectedFitness());
     }
   }
 
-  if (!FLAGS_games)
+  if (jobs.size() == 0)
     return;
 
-  // Run these random games
-  future = QtConcurrent::mapped(
-      requests, boost::bind(&GameMapper::Map, _1));
-  future.waitForFinished();
-  responses = future.results();
+  // As each sequence game finishes its player gets its fitness, and any of
+  // its random games that haven't started are reordered by how long the
+  // player really lasted rather than its parents' guess
+  auto sequence_done = [this](int job, const GameResult& result) {
+    if (job >= FLAGS_pop)
+      return;
+
+    player_pop_[result.player_id].SetFitness(result.fitness, result.censored);
+    for (int j = 0 ; j < FLAGS_games ; ++j)
+      scheduler_.Reprioritise(FLAGS_pop + job * FLAGS_games + j, result.fitness);
+  };
 
-  for (auto it = responses.begin() ; it != responses.end() ; ++it) {
-    const Messages::GameResponse& resp = *it;
+  // Run games
+  std::vector<GameResult> results = scheduler_.Run(jobs, costs, &PlayGame, sequence_done);
+  busy_usec_ += scheduler_.BusyMicroseconds();
+  capacity_usec_ += scheduler_.CapacityMicroseconds();
+
+  if (!FLAGS_games)
+    return;
 
-    int64_t original_fitness = player_pop_[resp.player_id()].Fitness();
-    int64_t random_fitness = resp.blocks_placed();
+  // Compare each player with its random games
+  for (auto it = results.begin() + FLAGS_pop ; it != results.end() ; ++it) {
+    int64_t original_fitness = player_pop_[it->player_id].Fitness();
+    int64_t random_fitness = it->fitness;
     int64_t diff = std::abs(original_fitness - random_fitness);
 
-    selector_pop_[resp.selector_id()].SetFitness(
-        selector_pop_[resp.selector_id()].Fitness() + diff);
+    selector_pop_[it->selector_id].SetFitness(
+        selector_pop_[it->selector_id].Fitness() + diff);
   }
 
   // Normalise the fitness of our sequences
@@ -304,6 +507,7 @@ void Engine<PlayerType, BoardType>::UpdateFitness() {
 
     if (FLAGS_watchseq) {
       GameType game(player_pop_[best_index], selector_pop_[best_index]);
+      game.SetBoardSize(board_width_, board_height_);
       game.SetWatchDelay(FLAGS_watchseqdelay);
       game.Play();
       std::cerr << game.BlocksPlaced() << "," << best_fitness << std::endl;
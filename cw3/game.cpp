@@ -1,3 +1,14 @@
 #include <google/gflags.h>
 
 DEFINE_uint64(stopafter, 1000000, "stop after this number of blocks have been placed");
+DEFINE_int32(ttsize, 4096, "number of moves each game remembers in its transposition table, 0 to disable");
+DEFINE_bool(ttmirror, false, "share transposition table entries between mirror image boards");
+DEFINE_int32(depth, 2, "number of pieces each move looks at, including the one being placed");
+DEFINE_int32(beam, 0, "number of boards kept after each ply of lookahead, 0 to keep them all");
+DEFINE_bool(expectimax, false, "average over every piece that could come next instead of looking at it");
+DEFINE_int32(ratingcache, 65536, "number of board ratings each expectimax game remembers, 0 to disable");
+DEFINE_bool(prune, false, "skip second plies that can't beat the best move so far, for linear players");
+DEFINE_uint64(censorafter, 0, "estimate how long games that reach this many blocks would last instead of playing them out, 0 to always play them out");
+DEFINE_int32(censorwindow, 10000, "number of recent blocks the estimate of how long a game will last is based on");
+DEFINE_double(censorinterval, 2.0, "censor games once the estimate's 95% interval spans no more than this factor");
+DEFINE_uint64(parallelafter, 10000, "share each move's search with any idle threads once a game has placed this many blocks, 0 to never");
@@ -3,8 +3,16 @@
 
 #include "tetrisboard.h"
 #include "tetramino.h"
-
+#include "placementtable.h"
+#include "transpositiontable.h"
+#include "ratingcache.h"
+#include "survivalestimator.h"
+#include "messages.pb.h"
+
+#include <algorithm>
+#include <deque>
 #include <limits>
+#include <vector>
 #include <math.h>
 #include <cstdint>
 
@@ -12,62 +20,319 @@
 
 #ifndef NO_QT_STUFF
 # include <QtDebug>
+# include <QtConcurrentMap>
+# include <boost/bind.hpp>
 #endif
 
 DECLARE_uint64(stopafter);
+DECLARE_int32(ttsize);
+DECLARE_bool(ttmirror);
+DECLARE_int32(depth);
+DECLARE_int32(beam);
+DECLARE_bool(expectimax);
+DECLARE_int32(ratingcache);
+DECLARE_bool(prune);
+DECLARE_uint64(censorafter);
+DECLARE_int32(censorwindow);
+DECLARE_double(censorinterval);
+DECLARE_uint64(parallelafter);
+
+// The most pieces Game can look at each step
+const int kMaxLookaheadDepth = 8;
 
 
 template <typename PlayerType, typename SelectorType, typename BoardType>
 class Game {
  public:
-  Game(PlayerType& player, SelectorType& selector);
+  typedef typename BoardType::PieceType PieceType;
+
+  // The player is only read, so several games can share one
+  Game(const PlayerType& player, SelectorType& selector);
 
-  PlayerType& GetPlayer() const { return player_; }
+  const PlayerType& GetPlayer() const { return player_; }
   SelectorType& GetBlockSelector() const { return block_selector_; }
   const BoardType& GetBoard() const { return board_; }
 
   void SetWatchDelay(int watch_delay) { watch_delay_ = watch_delay; }
 
-  // Plays a game of tetris, finishing when there's no room for any more blocks
-  void Play();
+  // Must be called for boards that are sized at runtime
+  void SetBoardSize(int width, int height);
+
+  // Looks at depth pieces each step, including the one being placed, keeping
+  // the best beam boards after each ply (0 keeps them all).  Defaults to
+  // -depth and -beam.  Depth 2 with no beam is an exhaustive search that
+  // also uses the transposition table.
+  void SetLookahead(int depth, int beam);
+  int Depth() const { return depth_; }
+  int Beam() const { return beam_; }
+
+  // Instead of looking at the next piece, picks the move with the best
+  // rating averaged over every piece that could come next.  Ignores the
+  // lookahead.  Defaults to -expectimax.
+  void SetExpectimax(bool expectimax);
+  bool Expectimax() const { return expectimax_; }
+
+  // Skips the second ply under first moves whose best possible total can't
+  // beat the best move found so far.  Only has an effect on the exhaustive
+  // two-ply search with players that can bound their ratings.  The moves
+  // picked are the same either way.  Defaults to -prune.
+  void SetPruning(bool prune) { prune_ = prune; }
+  bool Pruning() const { return prune_; }
+
+  // Once this many blocks have been placed, each two-ply search is shared
+  // with any idle threads in the global pool.  0 never shares.  The moves
+  // picked are the same either way.  Defaults to -parallelafter.
+  void SetParallelAfter(uint64_t blocks) { parallel_after_ = blocks; }
+
+  // How many first moves had their second ply searched and how many were
+  // pruned in the last game
+  uint64_t SubtreesSearched() const { return subtrees_searched_; }
+  uint64_t SubtreesPruned() const { return subtrees_pruned_; }
+
+  // Plays a game of tetris, finishing when there's no room for any more blocks.
+  // After -censorafter blocks the game can instead stop once the survival
+  // estimate says how much longer it would have lasted.
+  void Play() { Start(); Continue(0); }
+
+  // Plays a game a bit at a time.  Start sets up a new game and Continue
+  // places up to max_blocks more blocks (0 for no limit), returning true once
+  // the game has finished.
+  void Start();
+  bool Continue(uint64_t max_blocks);
+  bool Finished() const { return finished_; }
+
+  // Saves everything needed to carry on the game from where it is.  Carrying
+  // on from a snapshot with the same player, block selector and board size
+  // places exactly the same blocks as carrying on without stopping would.
+  void ToSnapshot(Messages::GameSnapshot* snapshot) const;
+  void FromSnapshot(const Messages::GameSnapshot& snapshot);
 
   // The number of blocks that we managed to place.  The more the better
   uint64_t BlocksPlaced() const { return blocks_placed_; }
 
+  // BlocksPlaced, or the number of blocks the game was expected to reach if
+  // it was censored.  Never more than -stopafter.
+  uint64_t Fitness() const { return fitness_; }
+  bool Censored() const { return censored_; }
+
  private:
   bool Step();
 
-  PlayerType& player_;
+  // Finds the best place to put tetramino1, looking ahead to tetramino2.
+  // Returns false if tetramino1 doesn't fit anywhere.  Uses the first ply
+  // saved by the last Search if there is one.  Ties go to the first move in
+  // placement order, whichever order the first moves are searched in.
+  bool Search(const PieceType& tetramino1, const PieceType& tetramino2,
+              int* best_x1, int* best_o1);
+
+  // Finds the best place for upcoming_[0] looking ahead to all the other
+  // upcoming pieces, keeping only the best beam_ boards after each ply.
+  // Returns false if no sequence of placements fits.
+  bool BeamSearch(int* best_x1, int* best_o1);
+
+  // Finds the best place for upcoming_[0] averaging over the next piece.
+  // Returns false if it doesn't fit anywhere.
+  bool ExpectimaxSearch(int* best_x1, int* best_o1);
+
+  // player_.Rating, remembered in rating_cache_
+  double CachedRating(const BoardType& board, int landing_height, int removed_lines);
+
+  // Places upcoming_[0] on the board and moves the other pieces up
+  void ApplyMove(int x, int orientation);
+
+  // The number of pieces in upcoming_
+  int KnownPieces() const { return expectimax_ ? 1 : depth_; }
+
+  // Feeds the board to survival_ and decides whether to stop the game early,
+  // setting fitness_ if so
+  bool Censor();
+
+  // Empties survival_, for a board this size
+  void ResetSurvival();
+
+  // Converts a move for tetramino into the same move on the mirror image board
+  void MirrorMove(const PieceType& tetramino, int* x, int* orientation) const;
+
+  const PlayerType& player_;
   SelectorType& block_selector_;
 
   BoardType board_;
-  Tetramino next_tetramino_;
+
+  // The pieces we know about.  The first one is placed by the next Step.
+  PieceType upcoming_[kMaxLookaheadDepth];
+  int depth_;
+  int beam_;
+  bool expectimax_;
+  bool prune_;
+  uint64_t parallel_after_;
+
+  // Where each tetramino can go on a board this wide
+  PlacementTable<PieceType> placements_;
+
+  // The moves Search picked before, so they can be reused when the same
+  // board and tetraminos come round again
+  TranspositionTable transpositions_;
+
+  // The landing heights and scores of every placement of the second
+  // tetramino on the board left by the move Search picked.  Once that move
+  // has been made they are the next Search's first ply, so it doesn't need
+  // to work them out again.
+  static const int kMaxPlacements = PieceType::kMaxOrientationCount * BoardType::kMaxWidth;
+  bool next_ply_valid_;
+  int next_ply_heights_[kMaxPlacements];
+  double next_ply_scores_[kMaxPlacements];
+
+  // What Search's second ply needs to know about the first
+  struct SecondPly {
+    const PieceType* tetramino1;
+    const PieceType* tetramino2;
+    const Placement* begin1;
+    const Placement* begin2;
+    const Placement* end2;
+    const int* heights1;
+    const double* scores1;
+    const double* bounds1; // Only set when pruning
+    const int* order;
+    int order_count;
+    bool prune;
+  };
+
+  // Searches the second ply under the first moves order[first],
+  // order[first + step] and so on, placing pieces on board.  Keeps the best
+  // first move it finds along with that move's second ply.
+  struct SearchWorker {
+    const SecondPly* ply;
+    int first;
+    int step;
+    BoardType* board;
+    BoardType own_board;
+
+    // The stats, ratings, landing heights and scores of the second ply
+    // under one first move
+    BoardStatsBatch<kMaxPlacements> stats;
+    double ratings[kMaxPlacements];
+    int heights2[kMaxPlacements];
+    double scores2[kMaxPlacements];
+
+    double best_score;
+    const Placement* best1; // NULL if nothing fitted
+    int best_heights2[kMaxPlacements];
+    double best_scores2[kMaxPlacements];
+    uint64_t searched;
+    uint64_t pruned;
+  };
+  void SearchSecondPly(SearchWorker* worker);
+
+  // Search's workers.  The first one searches on board_ when there's only
+  // one.
+  std::deque<SearchWorker> search_workers_;
+
+  // A placement for BeamSearch to make.  parent is the index of the board
+  // it's made on, and first is the first ply placement that board came from.
+  struct BeamNode {
+    int parent;
+    const Placement* placement;
+    int y;
+    double score;
+    const Placement* first;
+
+    bool operator <(const BeamNode& other) const { return score < other.score; }
+  };
+
+  // BeamSearch's boards for the current ply and the candidates for the
+  // next.  They're kept between steps so the boards aren't reallocated.
+  std::vector<BeamNode> beam_nodes_;
+  std::vector<BeamNode> beam_candidates_;
+  std::deque<BoardType> beam_boards_[2];
+
+  // Ratings of the boards ExpectimaxSearch has seen.  The boards the next
+  // step starts from were all rated by the step before, so they're found
+  // here.
+  RatingCache rating_cache_;
+
+  // How long the game is likely to last, once it's past -censorafter blocks
+  SurvivalEstimator survival_;
+  bool censored_;
+  bool finished_;
+  uint64_t fitness_;
 
   uint64_t blocks_placed_;
+  uint64_t subtrees_searched_;
+  uint64_t subtrees_pruned_;
   int watch_delay_;
 };
 
 
 template <typename PlayerType, typename SelectorType, typename BoardType>
-Game<PlayerType, SelectorType, BoardType>::Game(PlayerType& player,
+Game<PlayerType, SelectorType, BoardType>::Game(const PlayerType& player,
                                                 SelectorType& block_selector)
     : player_(player),
       block_selector_(block_selector),
+      next_ply_valid_(false),
+      censored_(false),
+      finished_(false),
+      fitness_(0),
       blocks_placed_(0),
+      subtrees_searched_(0),
+      subtrees_pruned_(0),
       watch_delay_(-1)
 {
   board_.Clear();
+  placements_.SetWidth(board_.Width());
+  transpositions_.SetSize(FLAGS_ttsize);
+  SetLookahead(FLAGS_depth, FLAGS_beam);
+  SetExpectimax(FLAGS_expectimax);
+  SetPruning(FLAGS_prune);
+  SetParallelAfter(FLAGS_parallelafter);
+}
+
+template <typename PlayerType, typename SelectorType, typename BoardType>
+void Game<PlayerType, SelectorType, BoardType>::SetBoardSize(int width, int height) {
+  board_.SetSize(width, height);
+  placements_.SetWidth(width);
 }
 
 template <typename PlayerType, typename SelectorType, typename BoardType>
-void Game<PlayerType, SelectorType, BoardType>::Play() {
+void Game<PlayerType, SelectorType, BoardType>::SetLookahead(int depth, int beam) {
+  assert(depth >= 1 && depth <= kMaxLookaheadDepth);
+  assert(beam >= 0);
+  depth_ = depth;
+  beam_ = beam;
+}
+
+template <typename PlayerType, typename SelectorType, typename BoardType>
+void Game<PlayerType, SelectorType, BoardType>::SetExpectimax(bool expectimax) {
+  expectimax_ = expectimax;
+  rating_cache_.SetSize(expectimax ? FLAGS_ratingcache : 0);
+}
+
+template <typename PlayerType, typename SelectorType, typename BoardType>
+void Game<PlayerType, SelectorType, BoardType>::Start() {
   block_selector_.Reset();
   board_.Clear();
+  next_ply_valid_ = false;
 
-  next_tetramino_.InitFrom(block_selector_());
+  for (int i=0 ; i<KnownPieces() - 1 ; ++i)
+    upcoming_[i].InitFrom(block_selector_());
 
   blocks_placed_ = 0;
-  while (Step()) {
+  subtrees_searched_ = 0;
+  subtrees_pruned_ = 0;
+  censored_ = false;
+  finished_ = false;
+  ResetSurvival();
+}
+
+template <typename PlayerType, typename SelectorType, typename BoardType>
+bool Game<PlayerType, SelectorType, BoardType>::Continue(uint64_t max_blocks) {
+  for (uint64_t placed=0 ; !finished_ ; ++placed) {
+    if (max_blocks && placed >= max_blocks)
+      return false;
+
+    if (!Step()) {
+      finished_ = true;
+      break;
+    }
     blocks_placed_ ++;
 
 #ifndef NO_QT_STUFF
@@ -77,76 +342,667 @@ void Game<PlayerType, SelectorType, BoardType>::Play() {
     }
 #endif
 
-    if (FLAGS_stopafter && blocks_placed_ >= FLAGS_stopafter)
-      break;
+    if ((FLAGS_stopafter && blocks_placed_ >= FLAGS_stopafter) ||
+        (FLAGS_censorafter && Censor()))
+      finished_ = true;
   }
+
+  if (!censored_)
+    fitness_ = blocks_placed_;
+  return true;
 }
 
 template <typename PlayerType, typename SelectorType, typename BoardType>
-bool Game<PlayerType, SelectorType, BoardType>::Step() {
-  // Pick the next two tetraminos
-  Tetramino tetramino1;
-  Tetramino tetramino2;
-  tetramino1.InitFrom(next_tetramino_);
-  tetramino2.InitFrom(block_selector_());
+void Game<PlayerType, SelectorType, BoardType>::ToSnapshot(Messages::GameSnapshot* snapshot) const {
+  snapshot->Clear();
+  for (int y=0 ; y<board_.Height() ; ++y)
+    snapshot->add_rows(board_.Row(y));
+  for (int i=0 ; i<KnownPieces() - 1 ; ++i)
+    snapshot->add_upcoming(upcoming_[i].Type());
+
+  snapshot->set_blocks_placed(blocks_placed_);
+  block_selector_.ToSnapshot(snapshot);
+  snapshot->set_depth(depth_);
+  snapshot->set_beam(beam_);
+  snapshot->set_expectimax(expectimax_);
+  snapshot->set_subtrees_searched(subtrees_searched_);
+  snapshot->set_subtrees_pruned(subtrees_pruned_);
+
+  if (FLAGS_ttmirror) {
+    transpositions_.ForEach([snapshot](uint64_t key, int x, int orientation) {
+      snapshot->add_transposition_keys(key);
+      snapshot->add_transposition_moves(x * 256 + orientation);
+    });
+  }
+
+  if (FLAGS_censorafter) {
+    std::vector<int> levels;
+    survival_.Levels(&levels);
+    for (auto it = levels.begin() ; it != levels.end() ; ++it)
+      snapshot->add_survival_levels(*it);
+  }
+}
 
-  const int oc1 = tetramino1.OrientationCount();
-  const int oc2 = tetramino2.OrientationCount();
+template <typename PlayerType, typename SelectorType, typename BoardType>
+void Game<PlayerType, SelectorType, BoardType>::FromSnapshot(const Messages::GameSnapshot& snapshot) {
+  if (snapshot.has_depth())
+    SetLookahead(snapshot.depth(), snapshot.beam());
+  SetExpectimax(snapshot.expectimax());
+
+  board_.SetRows(snapshot.rows().begin(), snapshot.rows().end());
+  for (int i=0 ; i<KnownPieces() - 1 && i<snapshot.upcoming_size() ; ++i)
+    upcoming_[i].InitFrom(snapshot.upcoming(i));
+  block_selector_.FromSnapshot(snapshot);
+  next_ply_valid_ = false;
+
+  blocks_placed_ = snapshot.blocks_placed();
+  subtrees_searched_ = snapshot.subtrees_searched();
+  subtrees_pruned_ = snapshot.subtrees_pruned();
+  censored_ = false;
+  finished_ = false;
+
+  transpositions_.SetSize(FLAGS_ttsize);
+  for (int i=0 ; i<snapshot.transposition_keys_size() ; ++i) {
+    const int move = snapshot.transposition_moves(i);
+    transpositions_.Insert(snapshot.transposition_keys(i), move / 256, move % 256);
+  }
 
-  double best_score = std::numeric_limits<double>::max();
+  ResetSurvival();
+  for (int i=0 ; i<snapshot.survival_levels_size() ; ++i)
+    survival_.AddBlock(snapshot.survival_levels(i));
+}
+
+template <typename PlayerType, typename SelectorType, typename BoardType>
+void Game<PlayerType, SelectorType, BoardType>::ResetSurvival() {
+  if (!FLAGS_censorafter)
+    return;
+
+  // The danger level is the total height of the columns, holes included.
+  // Some piece might not fit once the columns are on average closer to the
+  // top than that piece's flattest orientation is tall.
+  int tallest = 1;
+  PieceType tetramino;
+  for (int type=0 ; type<PieceType::kTypeCount ; ++type) {
+    tetramino.InitFrom(type);
+    int flattest = board_.Height();
+    for (const Placement* p = placements_.Begin(tetramino) ; p != placements_.End(tetramino) ; ++p)
+      flattest = std::min(flattest, p->height);
+    tallest = std::max(tallest, flattest);
+  }
+  survival_.Reset(FLAGS_censorwindow, std::max(board_.Height() - tallest, 1) * board_.Width());
+}
+
+template <typename PlayerType, typename SelectorType, typename BoardType>
+bool Game<PlayerType, SelectorType, BoardType>::Censor() {
+  // The window only needs to be full by -censorafter
+  if (blocks_placed_ + FLAGS_censorwindow < FLAGS_censorafter)
+    return false;
+
+  int level = 0;
+  for (int x=0 ; x<board_.Width() ; ++x)
+    level += board_.ColumnHeight(x);
+  survival_.AddBlock(level);
+
+  // Only look every tenth of a window, the estimate barely moves in between
+  const uint64_t check_every = std::max(FLAGS_censorwindow / 10, 1);
+  if (blocks_placed_ < FLAGS_censorafter || !survival_.Ready() ||
+      blocks_placed_ % check_every != 0)
+    return false;
+
+  double expected, lower, upper;
+  survival_.Estimate(&expected, &lower, &upper);
+
+  const double cap = FLAGS_stopafter ? double(FLAGS_stopafter)
+                                     : std::numeric_limits<double>::infinity();
+  if (blocks_placed_ + lower >= cap) {
+    // It would almost certainly have reached -stopafter
+    fitness_ = FLAGS_stopafter;
+  } else if (upper <= lower * FLAGS_censorinterval) {
+    fitness_ = std::min(blocks_placed_ + expected, cap);
+  } else {
+    return false;
+  }
+
+  censored_ = true;
+  return true;
+}
+
+template <typename PlayerType, typename SelectorType, typename BoardType>
+bool Game<PlayerType, SelectorType, BoardType>::Step() {
+  // We already know all but the last of the pieces we look at
+  upcoming_[KnownPieces() - 1].InitFrom(block_selector_());
+  const PieceType& tetramino1 = upcoming_[0];
 
-  // Best x position and orientation of first and second tetramino
   int best_x1 = -1;
   int best_o1 = -1;
-  int best_x2 = -1;
-  int best_o2 = -1;
-
-  for (int o1=0 ; o1<oc1 ; ++o1) {
-    int width1 = tetramino1.Size(o1).width();
-    for (int x1=0 ; x1<=BoardType::kWidth - width1 ; ++x1) {
-      BoardType board1;
-      board1.CopyFrom(board_);
-
-      // Add this first tetramino to the new board
-      double score1 = player_.Rating(board1, tetramino1, x1, o1);
-      if (isnan(score1))
+
+  if (expectimax_) {
+    next_ply_valid_ = false;
+    if (!ExpectimaxSearch(&best_x1, &best_o1))
+      return false;
+
+    ApplyMove(best_x1, best_o1);
+    return true;
+  }
+
+  if (depth_ != 2 || beam_ != 0) {
+    // The transposition table only knows about two pieces, so it's no use here
+    next_ply_valid_ = false;
+    if (!BeamSearch(&best_x1, &best_o1))
+      return false;
+
+    ApplyMove(best_x1, best_o1);
+    return true;
+  }
+
+  const PieceType& tetramino2 = upcoming_[1];
+
+  // Have we seen this position before?  With -ttmirror a board and its mirror
+  // image share an entry, using whichever one has the lower hash.
+  uint64_t key = 0;
+  bool mirrored = false;
+  bool found = false;
+
+  if (transpositions_.Enabled()) {
+    uint64_t hash = board_.Hash();
+    if (FLAGS_ttmirror) {
+      const uint64_t mirror_hash = board_.MirrorHash();
+      mirrored = mirror_hash < hash;
+      hash = std::min(hash, mirror_hash);
+    }
+
+    if (mirrored)
+      key = TranspositionTable::Key(hash, tetramino1.MirrorType(), tetramino2.MirrorType());
+    else
+      key = TranspositionTable::Key(hash, tetramino1.Type(), tetramino2.Type());
+
+    found = transpositions_.Find(key, &best_x1, &best_o1);
+    if (found && mirrored) {
+      PieceType mirror;
+      mirror.InitFrom(tetramino1.MirrorType());
+      MirrorMove(mirror, &best_x1, &best_o1);
+    }
+
+    // A different position with the same hash could have left a move that
+    // doesn't fit this board, so search again rather than trust it
+    if (found && board_.TetraminoHeight(tetramino1, best_x1, best_o1) < 0)
+      found = false;
+  }
+
+  if (!found) {
+    if (!Search(tetramino1, tetramino2, &best_x1, &best_o1))
+      return false;
+
+    if (transpositions_.Enabled()) {
+      int x = best_x1;
+      int orientation = best_o1;
+      if (mirrored)
+        MirrorMove(tetramino1, &x, &orientation);
+      transpositions_.Insert(key, x, orientation);
+    }
+  } else {
+    // The move didn't come from Search, so there's no saved ply for it
+    next_ply_valid_ = false;
+  }
+
+  ApplyMove(best_x1, best_o1);
+  return true;
+}
+
+template <typename PlayerType, typename SelectorType, typename BoardType>
+void Game<PlayerType, SelectorType, BoardType>::ApplyMove(int x, int orientation) {
+  const PieceType& tetramino = upcoming_[0];
+  int y = board_.TetraminoHeight(tetramino, x, orientation);
+  board_.Add(tetramino, x, y, orientation);
+  board_.ClearRows();
+
+  for (int i=0 ; i<KnownPieces() - 1 ; ++i)
+    upcoming_[i].InitFrom(upcoming_[i + 1]);
+}
+
+template <typename PlayerType, typename SelectorType, typename BoardType>
+void Game<PlayerType, SelectorType, BoardType>::MirrorMove(
+    const PieceType& tetramino, int* x, int* orientation) const {
+  *x = board_.Width() - *x - tetramino.Size(*orientation).width();
+  *orientation = tetramino.MirrorOrientation(*orientation);
+}
+
+template <typename PlayerType, typename SelectorType, typename BoardType>
+bool Game<PlayerType, SelectorType, BoardType>::Search(
+    const PieceType& tetramino1, const PieceType& tetramino2,
+    int* best_x1_out, int* best_o1_out) {
+  const Placement* begin1 = placements_.Begin(tetramino1);
+  const Placement* end1 = placements_.End(tetramino1);
+  const Placement* begin2 = placements_.Begin(tetramino2);
+  const Placement* end2 = placements_.End(tetramino2);
+
+  // Where the first tetramino would land for each of its placements, and the
+  // score of each placement
+  int heights1[kMaxPlacements];
+  double scores1[kMaxPlacements];
+
+  // The first ply was worked out by the last Search's second ply if this
+  // board is the one its best move left behind
+  const bool have_first_ply = next_ply_valid_;
+  if (have_first_ply) {
+    std::copy(next_ply_heights_, next_ply_heights_ + (end1 - begin1), heights1);
+    std::copy(next_ply_scores_, next_ply_scores_ + (end1 - begin1), scores1);
+  } else {
+    board_.PlacementHeights(begin1, end1, heights1);
+  }
+  next_ply_valid_ = false;
+
+  // Each placement is made on the board and undone again afterwards, so the
+  // board is only copied for workers on other threads
+  typename BoardType::UndoRecord undo1;
+
+  // When pruning, the lowest total each first move could get with any
+  // second move.  The second ply can't be more than this wide or high.
+  const bool prune = prune_ && PlayerType::HasRatingBound();
+  double bounds1[kMaxPlacements];
+  int width2 = 0;
+  int height2 = 0;
+  for (const Placement* p2 = begin2 ; p2 != end2 ; ++p2) {
+    width2 = std::max(width2, p2->width);
+    height2 = std::max(height2, p2->height);
+  }
+
+  // The first moves worth looking at, as indexes into the placements
+  int order[kMaxPlacements];
+  int order_count = 0;
+
+  for (const Placement* p1 = begin1 ; p1 != end1 ; ++p1) {
+    const int i = p1 - begin1;
+
+    // Can we add the tetramino here?  The saved score is NaN if the player
+    // wouldn't go there.
+    if (heights1[i] < 0 || (have_first_ply && isnan(scores1[i])))
+      continue;
+
+    if (have_first_ply && !prune) {
+      order[order_count++] = i;
+      continue;
+    }
+
+    int removed1 = board_.Place(tetramino1, p1->x, heights1[i], p1->orientation, &undo1);
+    if (!have_first_ply)
+      scores1[i] = player_.Rating(board_, heights1[i] + p1->height, removed1);
+
+    if (prune && !isnan(scores1[i])) {
+      BoardStats stats;
+      BoardStats lower;
+      BoardStats upper;
+      board_.Analyse(&stats);
+      board_.PlacementStatBounds(stats, tetramino2.PointsCount(), width2, height2,
+                                 &lower, &upper);
+      bounds1[i] = scores1[i] + player_.RatingLowerBound(lower, upper);
+    }
+    board_.Undo(undo1);
+
+    if (!isnan(scores1[i]))
+      order[order_count++] = i;
+  }
+
+  // The best first moves are likely to lead to the best totals, and the
+  // sooner a good total is found the more gets pruned
+  if (prune) {
+    std::stable_sort(order, order + order_count,
+                     [&scores1](int a, int b) { return scores1[a] < scores1[b]; });
+  }
+
+  const SecondPly ply = {&tetramino1, &tetramino2, begin1, begin2, end2,
+                         heights1, scores1, bounds1, order, order_count, prune};
+
+  // Past parallel_after_ blocks the first moves are shared out between this
+  // thread and any idle threads in the pool.  While a generation is being
+  // played every thread is usually busy with a game of its own, so this only
+  // kicks in once the short games have finished and left the long ones to
+  // it.  Each worker prunes against the best it has found itself, and the
+  // best of the workers' bests is picked in the same way as in one search,
+  // so the move is the same either way.
+  int worker_count = 1;
+#ifndef NO_QT_STUFF
+  if (parallel_after_ && blocks_placed_ >= parallel_after_) {
+    const QThreadPool* pool = QThreadPool::globalInstance();
+    const int idle = pool->maxThreadCount() - pool->activeThreadCount();
+    if (idle > 0)
+      worker_count = std::min(idle + 1, order_count);
+  }
+#endif
+
+  while (search_workers_.size() < size_t(worker_count))
+    search_workers_.emplace_back();
+
+  for (int w=0 ; w<worker_count ; ++w) {
+    SearchWorker& worker = search_workers_[w];
+    worker.ply = &ply;
+    worker.first = w;
+    worker.step = worker_count;
+    if (worker_count == 1) {
+      worker.board = &board_;
+    } else {
+      worker.own_board.CopyFrom(board_);
+      worker.board = &worker.own_board;
+    }
+  }
+
+#ifndef NO_QT_STUFF
+  if (worker_count > 1) {
+    std::vector<SearchWorker*> workers;
+    for (int w=0 ; w<worker_count ; ++w)
+      workers.push_back(&search_workers_[w]);
+    QtConcurrent::blockingMap(workers, boost::bind(&Game::SearchSecondPly, this, _1));
+  } else
+#endif
+  {
+    SearchSecondPly(&search_workers_[0]);
+  }
+
+  const SearchWorker* best = NULL;
+  for (int w=0 ; w<worker_count ; ++w) {
+    const SearchWorker& worker = search_workers_[w];
+    subtrees_searched_ += worker.searched;
+    subtrees_pruned_ += worker.pruned;
+
+    if (worker.best1 == NULL)
+      continue;
+    if (best == NULL || worker.best_score < best->best_score ||
+        (worker.best_score == best->best_score && worker.best1 < best->best1))
+      best = &worker;
+  }
+
+  if (best == NULL)
+    return false;
+
+  // Keep the second ply for the move picked
+  std::copy(best->best_heights2, best->best_heights2 + (end2 - begin2), next_ply_heights_);
+  std::copy(best->best_scores2, best->best_scores2 + (end2 - begin2), next_ply_scores_);
+  next_ply_valid_ = true;
+
+  *best_x1_out = best->best1->x;
+  *best_o1_out = best->best1->orientation;
+  return true;
+}
+
+template <typename PlayerType, typename SelectorType, typename BoardType>
+void Game<PlayerType, SelectorType, BoardType>::SearchSecondPly(SearchWorker* worker) {
+  const SecondPly& ply = *worker->ply;
+  BoardType& board = *worker->board;
+  const PieceType& tetramino1 = *ply.tetramino1;
+  const PieceType& tetramino2 = *ply.tetramino2;
+
+  double best_score = std::numeric_limits<double>::max();
+  const Placement* best1 = NULL;
+  worker->searched = 0;
+  worker->pruned = 0;
+
+  typename BoardType::UndoRecord undo1;
+  typename BoardType::UndoRecord undo2;
+  int* heights2 = worker->heights2;
+  double* scores2 = worker->scores2;
+
+  for (int k=worker->first ; k<ply.order_count ; k+=worker->step) {
+    const int i = ply.order[k];
+    const Placement* p1 = ply.begin1 + i;
+    const int y1 = ply.heights1[i];
+    const double score1 = ply.scores1[i];
+
+    // Can any second move make this better than the best so far?
+    if (ply.prune && best1 != NULL) {
+      const double bound = ply.bounds1[i];
+      if (bound > best_score || (bound == best_score && p1 > best1)) {
+        worker->pruned ++;
         continue;
+      }
+    }
+    worker->searched ++;
+
+    // Add this first tetramino to the board
+    board.Place(tetramino1, p1->x, y1, p1->orientation, &undo1);
+    board.PlacementHeights(ply.begin2, ply.end2, heights2);
 
-      for (int o2=0 ; o2<oc2 ; ++o2) {
-        int width2 = tetramino2.Size(o2).width();
-        for (int x2=0 ; x2<=BoardType::kWidth - width2 ; ++x2) {
-          BoardType board2;
-          board2.CopyFrom(board1);
-
-          // Add the second tetramino to the board
-          double score2 = player_.Rating(board2, tetramino2, x2, o2);
-          if (isnan(score2))
-            continue;
-
-          // Was this combination better than before?
-          if (score1 + score2 < best_score) {
-            best_score = score1 + score2;
-            best_x1 = x1;
-            best_x2 = x2;
-            best_o1 = o1;
-            best_o2 = o2;
-          }
+    // Get the stats for every second move, then rate them all at once
+    worker->stats.Clear();
+    for (const Placement* p2 = ply.begin2 ; p2 != ply.end2 ; ++p2) {
+      const int y2 = heights2[p2 - ply.begin2];
+      if (y2 < 0)
+        continue;
+
+      BoardStats stats;
+      stats.removed_lines = board.Place(tetramino2, p2->x, y2, p2->orientation, &undo2);
+      stats.landing_height = y2 + p2->height;
+      board.Analyse(&stats);
+      board.Undo(undo2);
+      worker->stats.Add(stats);
+    }
+    player_.RateBatch(worker->stats, worker->ratings);
+
+    bool improved = false;
+    const double* rating = worker->ratings;
+    for (const Placement* p2 = ply.begin2 ; p2 != ply.end2 ; ++p2) {
+      double& score2 = scores2[p2 - ply.begin2];
+      if (heights2[p2 - ply.begin2] < 0) {
+        score2 = std::numeric_limits<double>::quiet_NaN();
+        continue;
+      }
+
+      score2 = *(rating++);
+      if (isnan(score2))
+        continue;
+
+      // Was this combination better than before?  Equal totals go to the
+      // earlier first move.
+      const double total = score1 + score2;
+      if (total < best_score ||
+          (total == best_score && best1 != NULL && p1 < best1)) {
+        best_score = total;
+        best1 = p1;
+        improved = true;
+      }
+    }
+
+    // Keep the second ply for the best first move so far
+    if (improved) {
+      std::copy(heights2, heights2 + (ply.end2 - ply.begin2), worker->best_heights2);
+      std::copy(scores2, scores2 + (ply.end2 - ply.begin2), worker->best_scores2);
+    }
+
+    board.Undo(undo1);
+  }
+
+  worker->best_score = best_score;
+  worker->best1 = best1;
+}
+
+template <typename PlayerType, typename SelectorType, typename BoardType>
+bool Game<PlayerType, SelectorType, BoardType>::BeamSearch(
+    int* best_x1_out, int* best_o1_out) {
+  double best_score = std::numeric_limits<double>::max();
+  const Placement* best1 = NULL;
+
+  // The first ply is made on the real board, the later ones on copies in
+  // beam_boards_[current]
+  const BeamNode root = {0, NULL, 0, 0.0, NULL};
+  beam_nodes_.assign(1, root);
+  int current = 0;
+
+  int heights[kMaxPlacements];
+  typename BoardType::UndoRecord undo;
+
+  for (int ply=0 ; ply<depth_ ; ++ply) {
+    const PieceType& tetramino = upcoming_[ply];
+    const Placement* begin = placements_.Begin(tetramino);
+    const Placement* end = placements_.End(tetramino);
+    const bool last_ply = ply == depth_ - 1;
+
+    beam_candidates_.clear();
+
+    for (size_t i=0 ; i<beam_nodes_.size() ; ++i) {
+      const BeamNode& node = beam_nodes_[i];
+      BoardType& board = (ply == 0) ? board_ : beam_boards_[current][i];
+      board.PlacementHeights(begin, end, heights);
+
+      for (const Placement* p = begin ; p != end ; ++p) {
+        const int y = heights[p - begin];
+        if (y < 0)
+          continue;
+
+        int removed = board.Place(tetramino, p->x, y, p->orientation, &undo);
+        const double score = player_.Rating(board, y + p->height, removed);
+        board.Undo(undo);
+        if (isnan(score))
+          continue;
+
+        const BeamNode child = {int(i), p, y, node.score + score,
+                                (ply == 0) ? p : node.first};
+        if (!last_ply) {
+          beam_candidates_.push_back(child);
+        } else if (child.score < best_score) {
+          best_score = child.score;
+          best1 = child.first;
         }
       }
     }
+
+    if (last_ply)
+      break;
+    if (beam_candidates_.empty())
+      return false;
+
+    // Only keep the best boards
+    if (beam_ && beam_candidates_.size() > size_t(beam_)) {
+      std::partial_sort(beam_candidates_.begin(), beam_candidates_.begin() + beam_,
+                        beam_candidates_.end());
+      beam_candidates_.resize(beam_);
+    }
+
+    // Make the boards for the next ply
+    const int next = 1 - current;
+    std::deque<BoardType>& boards = beam_boards_[next];
+    while (boards.size() < beam_candidates_.size())
+      boards.emplace_back();
+
+    for (size_t i=0 ; i<beam_candidates_.size() ; ++i) {
+      const BeamNode& candidate = beam_candidates_[i];
+      const BoardType& parent =
+          (ply == 0) ? board_ : beam_boards_[current][candidate.parent];
+      boards[i].CopyFrom(parent);
+      boards[i].Add(tetramino, candidate.placement->x, candidate.y,
+                    candidate.placement->orientation);
+      boards[i].ClearRows();
+    }
+
+    beam_nodes_.swap(beam_candidates_);
+    current = next;
   }
 
-  if (best_score == std::numeric_limits<double>::max())
+  if (best1 == NULL)
     return false;
 
-  // Apply the best first move to the board
-  int best_y1 = board_.TetraminoHeight(tetramino1, best_x1, best_o1);
-  board_.Add(tetramino1, best_x1, best_y1, best_o1);
-  board_.ClearRows();
+  *best_x1_out = best1->x;
+  *best_o1_out = best1->orientation;
+  return true;
+}
+
+template <typename PlayerType, typename SelectorType, typename BoardType>
+bool Game<PlayerType, SelectorType, BoardType>::ExpectimaxSearch(
+    int* best_x1_out, int* best_o1_out) {
+  const PieceType& tetramino1 = upcoming_[0];
+  const Placement* begin1 = placements_.Begin(tetramino1);
+  const Placement* end1 = placements_.End(tetramino1);
+
+  // Every piece that could come next, all equally likely
+  PieceType next[PieceType::kTypeCount];
+  for (int type=0 ; type<PieceType::kTypeCount ; ++type)
+    next[type].InitFrom(type);
+
+  // Moves that leave no room for some of the next pieces are worse than any
+  // that leave room for all of them, however well they're rated
+  int best_dead = PieceType::kTypeCount + 1;
+  double best_score = std::numeric_limits<double>::max();
+  const Placement* best1 = NULL;
+
+  int heights1[kMaxPlacements];
+  int heights2[kMaxPlacements];
+  board_.PlacementHeights(begin1, end1, heights1);
+
+  typename BoardType::UndoRecord undo1;
+  typename BoardType::UndoRecord undo2;
+
+  for (const Placement* p1 = begin1 ; p1 != end1 ; ++p1) {
+    const int y1 = heights1[p1 - begin1];
+    if (y1 < 0)
+      continue;
+
+    // This board is shared by all the branches for the next piece
+    int removed1 = board_.Place(tetramino1, p1->x, y1, p1->orientation, &undo1);
+    const double score1 = CachedRating(board_, y1 + p1->height, removed1);
+    if (isnan(score1)) {
+      board_.Undo(undo1);
+      continue;
+    }
+
+    double total = 0.0;
+    int dead = 0;
+
+    for (int type=0 ; type<PieceType::kTypeCount ; ++type) {
+      const Placement* begin2 = placements_.Begin(next[type]);
+      const Placement* end2 = placements_.End(next[type]);
+      board_.PlacementHeights(begin2, end2, heights2);
+
+      // The best response to this piece
+      double best2 = std::numeric_limits<double>::max();
+      for (const Placement* p2 = begin2 ; p2 != end2 ; ++p2) {
+        const int y2 = heights2[p2 - begin2];
+        if (y2 < 0)
+          continue;
+
+        int removed2 = board_.Place(next[type], p2->x, y2, p2->orientation, &undo2);
+        const double score2 = CachedRating(board_, y2 + p2->height, removed2);
+        board_.Undo(undo2);
+
+        if (score2 < best2)
+          best2 = score2;
+      }
 
-  next_tetramino_.InitFrom(tetramino2);
+      if (best2 == std::numeric_limits<double>::max())
+        dead ++;
+      else
+        total += best2;
+    }
+
+    board_.Undo(undo1);
+
+    const int alive = PieceType::kTypeCount - dead;
+    const double score = score1 + (alive ? total / alive : 0.0);
+    if (dead < best_dead || (dead == best_dead && score < best_score)) {
+      best_dead = dead;
+      best_score = score;
+      best1 = p1;
+    }
+  }
 
+  if (best1 == NULL)
+    return false;
+
+  *best_x1_out = best1->x;
+  *best_o1_out = best1->orientation;
   return true;
 }
 
+template <typename PlayerType, typename SelectorType, typename BoardType>
+double Game<PlayerType, SelectorType, BoardType>::CachedRating(
+    const BoardType& board, int landing_height, int removed_lines) {
+  if (!rating_cache_.Enabled())
+    return player_.Rating(board, landing_height, removed_lines);
+
+  const uint64_t key = RatingCache::Key(board.Hash(), landing_height, removed_lines);
+  double rating;
+  if (!rating_cache_.Find(key, &rating)) {
+    rating = player_.Rating(board, landing_height, removed_lines);
+    rating_cache_.Insert(key, rating);
+  }
+  return rating;
+}
+
 #endif // GAME_H
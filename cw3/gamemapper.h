@@ -18,39 +18,88 @@ class GameMapper {
   template <typename PlayerType>
   static void Map2(const Messages::GameRequest& req, Messages::GameResponse* res);
 
-  template <typename PlayerType, typename SelectorType>
+  template <typename PlayerType, typename PieceSet>
   static void Map3(const Messages::GameRequest& req, Messages::GameResponse* res);
 
-  template <typename PlayerType, typename SelectorType, typename BoardType>
+  template <typename PlayerType, typename PieceSet, typename SelectorType>
   static void Map4(const Messages::GameRequest& req, Messages::GameResponse* res);
+
+  template <typename PlayerType, typename SelectorType, typename BoardType>
+  static void Map5(const Messages::GameRequest& req, int width, int height,
+                   Messages::GameResponse* res);
+
+  // Calls Map5 with the board type picked by VisitBoardType
+  template <typename PlayerType, typename SelectorType>
+  class Map5Visitor {
+   public:
+    Map5Visitor(const Messages::GameRequest& req, int width, int height,
+                Messages::GameResponse* resp)
+        : req_(req), width_(width), height_(height), resp_(resp) {}
+
+    template <typename BoardType>
+    void operator()(BoardType*) const {
+      Map5<PlayerType, SelectorType, BoardType>(req_, width_, height_, resp_);
+    }
+
+   private:
+    const Messages::GameRequest& req_;
+    int width_;
+    int height_;
+    Messages::GameResponse* resp_;
+  };
 };
 
 template <typename PlayerType>
 void GameMapper::Map2(const Messages::GameRequest& req, Messages::GameResponse* resp) {
+  switch (req.board().pieces()) {
+  case Messages::BoardType::TETRAMINOS:
+    Map3<PlayerType, TetraminoSet>(req, resp);
+    break;
+
+  case Messages::BoardType::PENTOMINOS:
+    Map3<PlayerType, PentominoSet>(req, resp);
+    break;
+
+  case Messages::BoardType::MIXED:
+    Map3<PlayerType, MixedSet>(req, resp);
+    break;
+
+  default:
+    std::cerr << "Bad piece set " << req.board().pieces() << std::endl;
+  }
+}
+
+template <typename PlayerType, typename PieceSet>
+void GameMapper::Map3(const Messages::GameRequest& req, Messages::GameResponse* resp) {
+  typedef Polyomino<PieceSet> PieceType;
+
   if (req.has_selector_random())
-    Map3<PlayerType, BlockSelector::Random>(req, resp);
+    Map4<PlayerType, PieceSet, BlockSelector::Random<PieceType> >(req, resp);
   else if (req.has_selector_sequence())
-    Map3<PlayerType, BlockSelector::Sequence<> >(req, resp);
+    Map4<PlayerType, PieceSet, BlockSelector::Sequence<1000000, PieceType> >(req, resp);
   else
     std::cerr << "Bad selector type" << std::endl;
 }
 
-template <typename PlayerType, typename SelectorType>
-void GameMapper::Map3(const Messages::GameRequest& req, Messages::GameResponse* resp) {
-  switch (req.board().width()) {
-    case 5: Map4<PlayerType, SelectorType, TetrisBoard<5, 10> >(req, resp); break;
-    case 6: Map4<PlayerType, SelectorType, TetrisBoard<6, 12> >(req, resp); break;
-    case 7: Map4<PlayerType, SelectorType, TetrisBoard<7, 14> >(req, resp); break;
-    case 8: Map4<PlayerType, SelectorType, TetrisBoard<8, 16> >(req, resp); break;
-    case 9: Map4<PlayerType, SelectorType, TetrisBoard<9, 18> >(req, resp); break;
-    case 10: Map4<PlayerType, SelectorType, TetrisBoard<10, 20> >(req, resp); break;
-
-    default: std::cerr << "Bad board width " << req.board().width() << std::endl;
+template <typename PlayerType, typename PieceSet, typename SelectorType>
+void GameMapper::Map4(const Messages::GameRequest& req, Messages::GameResponse* resp) {
+  const int width = req.board().width();
+
+  // Old requests don't have a height, and their boards were twice as high as
+  // they were wide
+  const int height = req.board().has_height() ? req.board().height() : width * 2;
+
+  if (!VisitBoardType<PieceSet>(width, height,
+          Map5Visitor<PlayerType, SelectorType>(req, width, height, resp))) {
+    std::cerr << "Bad board size " << width << "x" << height << ", boards must fit in "
+              << TetrisBoard<0, 0>::kMaxWidth << "x"
+              << TetrisBoard<0, 0>::kMaxHeight << " or be 64x128" << std::endl;
   }
 }
 
 template <typename PlayerType, typename SelectorType, typename BoardType>
-void GameMapper::Map4(const Messages::GameRequest& req, Messages::GameResponse* resp) {
+void GameMapper::Map5(const Messages::GameRequest& req, int width, int height,
+                      Messages::GameResponse* resp) {
   PlayerType player;
   player.FromMessage(req.player());
 
@@ -58,11 +107,22 @@ void GameMapper::Map4(const Messages::GameRequest& req, Messages::GameResponse*
   selector.FromMessage(req);
 
   Game<PlayerType, SelectorType, BoardType> game(player, selector);
-  game.Play();
+  game.SetBoardSize(width, height);
+  if (req.has_resume_from())
+    game.FromSnapshot(req.resume_from());
+  else
+    game.Start();
+  const bool finished = game.Continue(req.max_blocks());
 
   resp->set_player_id(req.player_id());
   resp->set_selector_id(req.selector_id());
   resp->set_blocks_placed(game.BlocksPlaced());
+  if (game.Censored()) {
+    resp->set_fitness(game.Fitness());
+    resp->set_censored(true);
+  }
+  if (!finished)
+    game.ToSnapshot(resp->mutable_snapshot());
 }
 
 #endif // GAMEMAPPER_H
@@ -2,6 +2,7 @@
 #define INDIVIDUAL_H
 
 #include <tr1/array>
+#include <vector>
 #include <limits>
 #include <algorithm>
 #include <cstdlib>
@@ -15,8 +16,6 @@
 #include "individualbase.h"
 #include "messages.pb.h"
 
-class Tetramino;
-
 enum RatingAlgorithm {
   RatingAlgorithm_Linear,
   RatingAlgorithm_Exponential,
@@ -57,6 +56,15 @@ class Individual : public IndividualBase {
   static bool HasExponents();
   static bool HasDisplacements();
 
+  // Whether RatingLowerBound gives anything better than -infinity
+  static bool HasRatingBound();
+
+  // Sizes the exponential algorithms' term tables to cover every stat value
+  // a board this big can have.  Tables are only built when genes change, so
+  // this has to be called before any individuals are created.  Until then
+  // they're sized for the biggest board with its size set at runtime.
+  static void SetBoardSize(int width, int height);
+
   // Creating a new individual
   void InitRandom();
   void MutateFrom(const Individual& parent);
@@ -73,10 +81,32 @@ class Individual : public IndividualBase {
 
   // Adds the given tetramino to this board and computes a score based on
   // this individual's weightings
-  template <int W, int H>
-  double Rating(TetrisBoard<W, H>& board, const Tetramino& tetramino,
+  template <int W, int H, typename P>
+  double Rating(TetrisBoard<W, H, P>& board, const Polyomino<P>& tetramino,
                 int x, int orientation) const;
 
+  // As above, but with the y position already worked out by
+  // TetrisBoard::TetraminoHeight.  y must be >= 0.
+  template <int W, int H, typename P>
+  double Rating(TetrisBoard<W, H, P>& board, const Polyomino<P>& tetramino,
+                int x, int y, int orientation) const;
+
+  // Rates a board that a tetramino has already been placed on.  landing_height
+  // is the distance from the top of the board to the bottom of the tetramino.
+  template <int W, int H, typename P>
+  double Rating(const TetrisBoard<W, H, P>& board,
+                int landing_height, int removed_lines) const;
+
+  // Rates every board in a batch, giving the same ratings as Rating would
+  template <int N>
+  void RateBatch(const BoardStatsBatch<N>& batch, double* ratings) const {
+    RateBatch(batch.values, BoardStatsBatch<N>::kStride, batch.size, ratings);
+  }
+
+  // The lowest rating a board could get if each of its stats is somewhere
+  // between lower and upper (see TetrisBoard::PlacementStatBounds).
+  double RatingLowerBound(const BoardStats& lower, const BoardStats& upper) const;
+
   // Compares the fitness and weights.  Will always return false unless both
   // have a fitness (to implement "invalid" default constructed values).
   bool operator ==(const Individual& other) const;
@@ -90,6 +120,22 @@ class Individual : public IndividualBase {
   RealGenes exponents_;
   RealGenes displacements_;
 
+  // For the exponential algorithms, each criterion's weighted power of
+  // every stat value the board can have, so rating doesn't call pow.
+  // Criterion c's terms start at sTermOffsets[c].  Stats that can go past
+  // kMaxTermTableSize, like weighted blocks on big boards, only have the
+  // values below it in the table and call pow above that.  Has to be rebuilt
+  // whenever the genes change.
+  static const int kMaxTermTableSize = 4096;
+  typedef std::tr1::array<int, Criteria_Count + 1> TermOffsets;
+  static TermOffsets TermOffsetsFor(int width, int height);
+  static TermOffsets sTermOffsets;
+  std::vector<double> terms_;
+  void BuildTermTables();
+
+  // One criterion's contribution to the rating
+  double Term(int criterion, int value) const;
+
   typedef boost::normal_distribution<double> DistributionType;
   static DistributionType sWeightDistribution;
   static DistributionType sExponentDistribution;
@@ -98,8 +144,14 @@ class Individual : public IndividualBase {
   // The specialisations of this function use our weights, exponents and
   // displacements to find a rating for a BoardStats struct
   double Rating(const BoardStats& stats) const;
+
+  // The same for count boards with each criterion's values stride apart
+  void RateBatch(const int32_t* values, int stride, int count, double* ratings) const;
 };
 
+static_assert(int(Criteria_Count) == int(BoardStatsBatch<1>::kStatsCount),
+              "BoardStats needs a field for every criterion");
+
 #ifndef QT_NO_DEBUG
   template <typename T, std::size_t N>
   QDebug operator<<(QDebug s, const std::tr1::array<T, N>& a);
@@ -114,6 +166,9 @@ template <RatingAlgorithm A>
 typename Individual<A>::DistributionType Individual<A>::sExponentDistribution(1.0, FLAGS_pemstddev);
 template <RatingAlgorithm A>
 typename Individual<A>::DistributionType Individual<A>::sDisplacementDistribution(1.0, FLAGS_pdmstddev);
+template <RatingAlgorithm A>
+typename Individual<A>::TermOffsets Individual<A>::sTermOffsets(
+    Individual<A>::TermOffsetsFor(TetrisBoard<0, 0>::kMaxWidth, TetrisBoard<0, 0>::kMaxHeight));
 
 
 template <RatingAlgorithm A>
@@ -136,8 +191,8 @@ bool Individual<A>::operator ==(const Individual<A>& other) const {
 }
 
 template <RatingAlgorithm A>
-template <int W, int H>
-double Individual<A>::Rating(TetrisBoard<W, H>& board, const Tetramino& tetramino,
+template <int W, int H, typename P>
+double Individual<A>::Rating(TetrisBoard<W, H, P>& board, const Polyomino<P>& tetramino,
                           int x, int orientation) const {
   assert(weights_.size() == Criteria_Count);
 
@@ -148,14 +203,31 @@ double Individual<A>::Rating(TetrisBoard<W, H>& board, const Tetramino& tetramin
     return std::numeric_limits<double>::quiet_NaN();
   }
 
+  return Rating(board, tetramino, x, y, orientation);
+}
+
+template <RatingAlgorithm A>
+template <int W, int H, typename P>
+double Individual<A>::Rating(TetrisBoard<W, H, P>& board, const Polyomino<P>& tetramino,
+                             int x, int y, int orientation) const {
+  assert(y >= 0);
+
   // Add the tetramino to the board
   board.Add(tetramino, x, y, orientation);
 
-  BoardStats stats;
-  stats.landing_height = y + tetramino.Size(orientation).height();
-
   // Count the rows that were removed by adding this tetramino
-  stats.removed_lines = board.ClearRows();
+  const int removed_lines = board.ClearRows();
+
+  return Rating(board, y + tetramino.Size(orientation).height(), removed_lines);
+}
+
+template <RatingAlgorithm A>
+template <int W, int H, typename P>
+double Individual<A>::Rating(const TetrisBoard<W, H, P>& board,
+                             int landing_height, int removed_lines) const {
+  BoardStats stats;
+  stats.landing_height = landing_height;
+  stats.removed_lines = removed_lines;
 
   board.Analyse(&stats);
 
@@ -198,6 +270,49 @@ void Individual<A>::FromMessage(const Messages::Player& message) {
   std::copy(message.weights().begin(), message.weights().end(), weights_.begin());
   std::copy(message.exponents().begin(), message.exponents().end(), exponents_.begin());
   std::copy(message.displacements().begin(), message.displacements().end(), displacements_.begin());
+  BuildTermTables();
+}
+
+template <RatingAlgorithm A>
+void Individual<A>::SetBoardSize(int width, int height) {
+  sTermOffsets = TermOffsetsFor(width, height);
+}
+
+template <RatingAlgorithm A>
+typename Individual<A>::TermOffsets Individual<A>::TermOffsetsFor(int width, int height) {
+  const int cells = width * height;
+
+  int max_values[Criteria_Count];
+  max_values[Criteria_PileHeight] = height;
+  max_values[Criteria_Holes] = cells;
+  max_values[Criteria_ConnectedHoles] = cells;
+  max_values[Criteria_RemovedLines] = height;
+  max_values[Criteria_AltitudeDifference] = height;
+  max_values[Criteria_MaxWellDepth] = height;
+  max_values[Criteria_SumWellDepth] = cells;
+  max_values[Criteria_LandingHeight] = height;
+  max_values[Criteria_Blocks] = cells;
+  max_values[Criteria_WeightedBlocks] = cells * (height + 1) / 2;
+  max_values[Criteria_RowTransitions] = (width + 1) * height;
+  max_values[Criteria_ColumnTransitions] = width * (height + 1);
+
+  TermOffsets offsets;
+  offsets[0] = 0;
+  for (int c=0 ; c<Criteria_Count ; ++c)
+    offsets[c + 1] = offsets[c] + std::min(max_values[c] + 1, int(kMaxTermTableSize));
+  return offsets;
+}
+
+template <RatingAlgorithm A>
+void Individual<A>::BuildTermTables() {
+  if (!HasExponents())
+    return;
+
+  terms_.resize(sTermOffsets[Criteria_Count]);
+  for (int c=0 ; c<Criteria_Count ; ++c) {
+    for (int index=sTermOffsets[c] ; index<sTermOffsets[c + 1] ; ++index)
+      terms_[index] = Term(c, index - sTermOffsets[c]);
+  }
 }
 
 #ifndef QT_NO_DEBUG
@@ -2,11 +2,14 @@
 
 IndividualBase::IndividualBase()
   : has_fitness_(false),
-    fitness_(0)
+    fitness_censored_(false),
+    fitness_(0),
+    expected_fitness_(0)
 {
 }
 
-void IndividualBase::SetFitness(uint64_t fitness) {
+void IndividualBase::SetFitness(uint64_t fitness, bool censored) {
   fitness_ = fitness;
+  fitness_censored_ = censored;
   has_fitness_ = true;
 }
@@ -7,14 +7,25 @@ class IndividualBase {
  public:
   IndividualBase();
 
-  // Sets this individual's fitness from the results of some game
-  void SetFitness(uint64_t fitness);
+  // Sets this individual's fitness from the results of some game.  A censored
+  // fitness is an estimate for a game that was stopped early, and is used
+  // the same way as any other.
+  void SetFitness(uint64_t fitness, bool censored = false);
   bool HasFitness() const { return has_fitness_; }
   uint64_t Fitness() const { return fitness_; }
+  bool FitnessCensored() const { return fitness_censored_; }
+
+  // What this individual's fitness will probably be before it has played,
+  // so the longest games can be started first.  Children get the mean of
+  // their parents' fitness.
+  void SetExpectedFitness(uint64_t fitness) { expected_fitness_ = fitness; }
+  uint64_t ExpectedFitness() const { return expected_fitness_; }
 
  private:
   bool has_fitness_;
+  bool fitness_censored_;
   uint64_t fitness_;
+  uint64_t expected_fitness_;
 };
 
 #endif // INDIVIDUALBASE_H
@@ -2,8 +2,11 @@
 
 #include <google/gflags.h>
 
+#include <cstdio>
+
 DEFINE_string(algo, "l", "board rating function - l, e or ed");
-DEFINE_string(size, "6x12", "board size");
+DEFINE_string(size, "6x12", "board size, as WIDTHxHEIGHT");
+DEFINE_string(pieces, "tetraminos", "piece set - tetraminos, pentominos or mixed");
 
 #ifndef QT_NO_DEBUG
 # include <QTest>
@@ -11,6 +14,7 @@ DEFINE_string(size, "6x12", "board size");
 # include "test_board.h"
 # include "test_tetramino.h"
 # include "test_generators.h"
+# include "test_game.h"
 
   template <typename T>
   void RunTest(const QStringList& args = QStringList()) {
@@ -22,24 +26,38 @@ DEFINE_string(size, "6x12", "board size");
   }
 #endif
 
-template <typename IndividualType, int W, int H>
-void Run2() {
-  Engine<IndividualType, TetrisBoard<W, H> > e;
-  e.Run();
-}
-
-template <int W, int H>
-void Run() {
-  if (FLAGS_algo == "l")
-    Run2<Individual<RatingAlgorithm_Linear>, W, H>();
-  else if (FLAGS_algo == "e")
-    Run2<Individual<RatingAlgorithm_Exponential>, W, H>();
-  else if (FLAGS_algo == "ed")
-    Run2<Individual<RatingAlgorithm_ExponentialWithDisplacement>, W, H>();
+template <typename IndividualType, typename BoardType>
+void Run2(int width, int height) {
+  IndividualType::SetBoardSize(width, height);
+  Engine<IndividualType, BoardType> e(width, height);
+  if (FLAGS_bench)
+    e.Benchmark();
   else
-    qFatal("Unknown algorithm %s", FLAGS_algo.c_str());
+    e.Run();
 }
 
+// Runs the engine with the board type picked by VisitBoardType
+class RunEngine {
+ public:
+  RunEngine(int width, int height) : width_(width), height_(height) {}
+
+  template <typename BoardType>
+  void operator()(BoardType*) const {
+    if (FLAGS_algo == "l")
+      Run2<Individual<RatingAlgorithm_Linear>, BoardType>(width_, height_);
+    else if (FLAGS_algo == "e")
+      Run2<Individual<RatingAlgorithm_Exponential>, BoardType>(width_, height_);
+    else if (FLAGS_algo == "ed")
+      Run2<Individual<RatingAlgorithm_ExponentialWithDisplacement>, BoardType>(width_, height_);
+    else
+      qFatal("Unknown algorithm %s", FLAGS_algo.c_str());
+  }
+
+ private:
+  int width_;
+  int height_;
+};
+
 int main(int argc, char** argv) {
   std::string usage("COMP6026 tetris evolver.  Usage:\n  ");
   usage += argv[0] + std::string(" -size 6x12");
@@ -51,6 +69,7 @@ int main(int argc, char** argv) {
     RunTest<Test::Board>();
     RunTest<Test::Tetramino>();
     RunTest<Test::Generators>();
+    RunTest<Test::Game>();
 
     return 0;
   }
@@ -58,18 +77,36 @@ int main(int argc, char** argv) {
 
   Utilities::global_rng.seed(Utilities::RandomSeed());
 
-  // Statically initalise the little bastard so there's not a race condition
-  // when doing him from inside the worker threads
-  Tetramino little_bastard;
+  int width = 0;
+  int height = 0;
+  char trailing;
+  if (sscanf(FLAGS_size.c_str(), "%dx%d%c", &width, &height, &trailing) != 2) {
+    std::cerr << "Board size should look like 10x20, not " << FLAGS_size << std::endl;
+    return 1;
+  }
+
+  if (FLAGS_depth < 1 || FLAGS_depth > kMaxLookaheadDepth || FLAGS_beam < 0) {
+    std::cerr << "Lookahead depth must be from 1 to " << kMaxLookaheadDepth
+              << " and beam can't be negative" << std::endl;
+    return 1;
+  }
 
-  if      (FLAGS_size == "5x10") Run<5,10>();
-  else if (FLAGS_size == "6x12") Run<6,12>();
-  else if (FLAGS_size == "7x14") Run<7,14>();
-  else if (FLAGS_size == "8x16") Run<8,16>();
-  else if (FLAGS_size == "9x18") Run<9,18>();
-  else if (FLAGS_size == "10x20") Run<10,20>();
+  bool size_ok;
+  if (FLAGS_pieces == "tetraminos")
+    size_ok = VisitBoardType<TetraminoSet>(width, height, RunEngine(width, height));
+  else if (FLAGS_pieces == "pentominos")
+    size_ok = VisitBoardType<PentominoSet>(width, height, RunEngine(width, height));
+  else if (FLAGS_pieces == "mixed")
+    size_ok = VisitBoardType<MixedSet>(width, height, RunEngine(width, height));
   else {
-    std::cerr << "Non-standard board size " << FLAGS_size;
+    std::cerr << "Unknown piece set " << FLAGS_pieces << std::endl;
+    return 1;
+  }
+
+  if (!size_ok) {
+    std::cerr << "Bad board size " << FLAGS_size << ", boards must fit in "
+              << TetrisBoard<0, 0>::kMaxWidth << "x"
+              << TetrisBoard<0, 0>::kMaxHeight << " or be 64x128" << std::endl;
     return 1;
   }
 
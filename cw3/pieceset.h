@@ -0,0 +1,357 @@
+#ifndef PIECESET_H
+#define PIECESET_H
+
+#include "utilities.h"
+#include "messages.pb.h"
+
+// A piece set describes every orientation of every piece that can be played.
+// Polyomino, TetrisBoard and Game are templated on the piece set, and all of
+// its tables are constant expressions, so a set costs nothing at runtime.
+// Each set provides:
+//
+//   kTypeCount, kMaxOrientationCount, kBlockSize, kMaxPointsCount, kMessageType
+//   OrientationCount(type), PointsCount(type)
+//   Points(type, orientation), Size(type, orientation), Bottom(type, orientation)
+//   MirrorType(type), MirrorOrientation(type, orientation)
+//
+// Points are sorted by x then y, so two orientations with the same points
+// are the same shape.  Bottom gives the y offset of the lowest point in each
+// column, -1 for columns the piece doesn't cover.
+
+
+// The classic seven tetraminos, with the orientations in the order they are
+// drawn in data/tetraminos.png
+struct TetraminoSet {
+  static const int kTypeCount = 7;
+  static const int kMaxOrientationCount = 4;
+  static const int kBlockSize = 4;
+  static const int kMaxPointsCount = 4;
+  static const Messages::BoardType::Pieces kMessageType = Messages::BoardType::TETRAMINOS;
+
+  static constexpr int OrientationCount(int type);
+  static constexpr int PointsCount(int) { return kMaxPointsCount; }
+  static constexpr const Int2* Points(int type, int orientation);
+  static constexpr const Int2& Size(int type, int orientation);
+  static constexpr const int* Bottom(int type, int orientation);
+  static constexpr int MirrorType(int type);
+  static constexpr int MirrorOrientation(int type, int orientation);
+};
+
+#include "data/tetraminos.h"
+
+constexpr int TetraminoSet::OrientationCount(int type) {
+  return TetraminoData::kOrientationCount[type];
+}
+
+constexpr const Int2* TetraminoSet::Points(int type, int orientation) {
+  return TetraminoData::kPoints[type][orientation];
+}
+
+constexpr const Int2& TetraminoSet::Size(int type, int orientation) {
+  return TetraminoData::kSize[type][orientation];
+}
+
+constexpr const int* TetraminoSet::Bottom(int type, int orientation) {
+  return TetraminoData::kBottom[type][orientation];
+}
+
+constexpr int TetraminoSet::MirrorType(int type) {
+  return TetraminoData::kMirrorType[type];
+}
+
+constexpr int TetraminoSet::MirrorOrientation(int type, int orientation) {
+  return TetraminoData::kMirrorOrientation[type][orientation];
+}
+
+
+namespace PieceSetGenerator {
+
+  // The tables for a generated piece set, filled in at compile time
+  template <int TypeCount, int BlockSize, int MaxPointsCount>
+  struct Tables {
+    static const int kMaxOrientationCount = 4;
+
+    int orientation_count[TypeCount];
+    int points_count[TypeCount];
+    Int2 points[TypeCount][kMaxOrientationCount][MaxPointsCount];
+    Int2 size[TypeCount][kMaxOrientationCount];
+    int bottom[TypeCount][kMaxOrientationCount][BlockSize];
+    int mirror_type[TypeCount];
+    int mirror_orientation[TypeCount][kMaxOrientationCount];
+
+    // False if the mirror image of some piece isn't in the set
+    bool mirrors_complete;
+  };
+
+  template <int MaxPointsCount>
+  struct Shape {
+    constexpr Shape() : count(0) {}
+
+    int count;
+    Int2 points[MaxPointsCount];
+  };
+
+  // Moves the shape into the top left corner and sorts its points
+  template <int N>
+  constexpr Shape<N> Normalise(Shape<N> shape) {
+    int min_x = shape.points[0].x();
+    int min_y = shape.points[0].y();
+    for (int i=1 ; i<shape.count ; ++i) {
+      min_x = shape.points[i].x() < min_x ? shape.points[i].x() : min_x;
+      min_y = shape.points[i].y() < min_y ? shape.points[i].y() : min_y;
+    }
+
+    for (int i=0 ; i<shape.count ; ++i) {
+      shape.points[i] = Int2(shape.points[i].x() - min_x, shape.points[i].y() - min_y);
+    }
+
+    for (int i=1 ; i<shape.count ; ++i) {
+      for (int j=i ; j>0 ; --j) {
+        const Int2 a = shape.points[j-1];
+        const Int2 b = shape.points[j];
+        if (a.x() < b.x() || (a.x() == b.x() && a.y() < b.y()))
+          break;
+        shape.points[j-1] = b;
+        shape.points[j] = a;
+      }
+    }
+    return shape;
+  }
+
+  // A quarter turn clockwise
+  template <int N>
+  constexpr Shape<N> Rotate(Shape<N> shape) {
+    for (int i=0 ; i<shape.count ; ++i) {
+      shape.points[i] = Int2(-shape.points[i].y(), shape.points[i].x());
+    }
+    return Normalise(shape);
+  }
+
+  // Left to right
+  template <int N>
+  constexpr Shape<N> Reflect(Shape<N> shape) {
+    for (int i=0 ; i<shape.count ; ++i) {
+      shape.points[i] = Int2(-shape.points[i].x(), shape.points[i].y());
+    }
+    return Normalise(shape);
+  }
+
+  template <int N>
+  constexpr bool Equal(const Shape<N>& shape, int count, const Int2* points) {
+    if (shape.count != count)
+      return false;
+    for (int i=0 ; i<count ; ++i) {
+      if (!(shape.points[i] == points[i]))
+        return false;
+    }
+    return true;
+  }
+
+  // Reads each piece from Shapes::Cell, then adds its distinct rotations
+  template <typename Shapes>
+  constexpr Tables<Shapes::kTypeCount, Shapes::kBlockSize, Shapes::kMaxPointsCount> Generate() {
+    typedef Tables<Shapes::kTypeCount, Shapes::kBlockSize, Shapes::kMaxPointsCount> TablesType;
+    typedef Shape<Shapes::kMaxPointsCount> ShapeType;
+
+    TablesType tables {};
+
+    for (int type=0 ; type<Shapes::kTypeCount ; ++type) {
+      ShapeType shape;
+      for (int x=0 ; x<Shapes::kBlockSize ; ++x) {
+        for (int y=0 ; y<Shapes::kBlockSize ; ++y) {
+          if (Shapes::Cell(type, x, y))
+            shape.points[shape.count++] = Int2(x, y);
+        }
+      }
+      shape = Normalise(shape);
+      tables.points_count[type] = shape.count;
+
+      for (int rotation=0 ; rotation<TablesType::kMaxOrientationCount ; ++rotation) {
+        bool duplicate = false;
+        for (int other=0 ; other<tables.orientation_count[type] ; ++other) {
+          duplicate = duplicate || Equal(shape, shape.count, tables.points[type][other]);
+        }
+
+        if (!duplicate) {
+          const int orientation = tables.orientation_count[type]++;
+          int width = 0;
+          int height = 0;
+          for (int x=0 ; x<Shapes::kBlockSize ; ++x) {
+            tables.bottom[type][orientation][x] = -1;
+          }
+          for (int i=0 ; i<shape.count ; ++i) {
+            const Int2 point = shape.points[i];
+            tables.points[type][orientation][i] = point;
+            width = point.x() + 1 > width ? point.x() + 1 : width;
+            height = point.y() + 1 > height ? point.y() + 1 : height;
+            if (point.y() > tables.bottom[type][orientation][point.x()])
+              tables.bottom[type][orientation][point.x()] = point.y();
+          }
+          tables.size[type][orientation] = Int2(width, height);
+        }
+
+        shape = Rotate(shape);
+      }
+    }
+
+    // Find each orientation's mirror image
+    tables.mirrors_complete = true;
+    for (int type=0 ; type<Shapes::kTypeCount ; ++type) {
+      for (int orientation=0 ; orientation<tables.orientation_count[type] ; ++orientation) {
+        ShapeType shape;
+        shape.count = tables.points_count[type];
+        for (int i=0 ; i<shape.count ; ++i) {
+          shape.points[i] = tables.points[type][orientation][i];
+        }
+        shape = Reflect(shape);
+
+        bool found = false;
+        for (int other_type=0 ; other_type<Shapes::kTypeCount ; ++other_type) {
+          for (int other=0 ; other<tables.orientation_count[other_type] ; ++other) {
+            if (Equal(shape, tables.points_count[other_type], tables.points[other_type][other])) {
+              tables.mirror_type[type] = other_type;
+              tables.mirror_orientation[type][orientation] = other;
+              found = true;
+            }
+          }
+        }
+        tables.mirrors_complete = tables.mirrors_complete && found;
+      }
+    }
+
+    return tables;
+  }
+
+  // Whether a row of a drawing like "XX." has a piece at x
+  constexpr bool DrawingCell(const char* row, int x) {
+    if (row == nullptr)
+      return false;
+    for (int i=0 ; i<x ; ++i) {
+      if (row[i] == '\0')
+        return false;
+    }
+    return row[x] == 'X';
+  }
+
+} // namespace PieceSetGenerator
+
+
+// A piece set generated at compile time from one orientation of each piece.
+// Shapes provides kTypeCount, kBlockSize, kMaxPointsCount, kMessageType and
+// Cell(type, x, y).
+template <typename Shapes>
+struct GeneratedPieceSet {
+  typedef PieceSetGenerator::Tables<Shapes::kTypeCount, Shapes::kBlockSize,
+                                    Shapes::kMaxPointsCount> TablesType;
+
+  static const int kTypeCount = Shapes::kTypeCount;
+  static const int kMaxOrientationCount = TablesType::kMaxOrientationCount;
+  static const int kBlockSize = Shapes::kBlockSize;
+  static const int kMaxPointsCount = Shapes::kMaxPointsCount;
+  static const Messages::BoardType::Pieces kMessageType = Shapes::kMessageType;
+
+  static constexpr TablesType kTables = PieceSetGenerator::Generate<Shapes>();
+  static_assert(kTables.mirrors_complete, "The mirror image of every piece must be in the set");
+
+  static constexpr int OrientationCount(int type) { return kTables.orientation_count[type]; }
+  static constexpr int PointsCount(int type) { return kTables.points_count[type]; }
+  static constexpr const Int2* Points(int type, int orientation) {
+    return kTables.points[type][orientation];
+  }
+  static constexpr const Int2& Size(int type, int orientation) {
+    return kTables.size[type][orientation];
+  }
+  static constexpr const int* Bottom(int type, int orientation) {
+    return kTables.bottom[type][orientation];
+  }
+  static constexpr int MirrorType(int type) { return kTables.mirror_type[type]; }
+  static constexpr int MirrorOrientation(int type, int orientation) {
+    return kTables.mirror_orientation[type][orientation];
+  }
+};
+
+template <typename Shapes>
+constexpr typename GeneratedPieceSet<Shapes>::TablesType GeneratedPieceSet<Shapes>::kTables;
+
+
+// Drawings of each piece, one row per string
+namespace PieceDrawings {
+
+  constexpr const char* kTetraminos[7][4] = {
+    { "XXXX" },        // I
+    { "X..", "XXX" },  // J
+    { "..X", "XXX" },  // L
+    { "XX", "XX" },    // O
+    { ".XX", "XX." },  // S
+    { ".X.", "XXX" },  // T
+    { "XX.", ".XX" },  // Z
+  };
+
+  // The one-sided pentominos: the twelve free pentominos plus the mirror
+  // images of the six that aren't symmetric
+  constexpr const char* kPentominos[18][5] = {
+    { ".XX", "XX.", ".X." },  // F
+    { "XX.", ".XX", ".X." },  // F mirrored
+    { "XXXXX" },              // I
+    { "XXXX", "X..." },       // L
+    { "XXXX", "...X" },       // L mirrored
+    { "XX..", ".XXX" },       // N
+    { "..XX", "XXX." },       // N mirrored
+    { "XX", "XX", "X." },     // P
+    { "XX", "XX", ".X" },     // P mirrored
+    { "XXX", ".X.", ".X." },  // T
+    { "X.X", "XXX" },         // U
+    { "X..", "X..", "XXX" },  // V
+    { "X..", "XX.", ".XX" },  // W
+    { ".X.", "XXX", ".X." },  // X
+    { "XXXX", ".X.." },       // Y
+    { "XXXX", "..X." },       // Y mirrored
+    { "XX.", ".X.", ".XX" },  // Z
+    { ".XX", ".X.", "XX." },  // Z mirrored
+  };
+
+} // namespace PieceDrawings
+
+// The tetraminos generated from drawings rather than read from the image.
+// Their orientations may be in a different order to TetraminoSet's.
+struct TetraminoShapes {
+  static const int kTypeCount = 7;
+  static const int kBlockSize = 4;
+  static const int kMaxPointsCount = 4;
+  static const Messages::BoardType::Pieces kMessageType = Messages::BoardType::TETRAMINOS;
+
+  static constexpr bool Cell(int type, int x, int y) {
+    return PieceSetGenerator::DrawingCell(PieceDrawings::kTetraminos[type][y], x);
+  }
+};
+
+struct PentominoShapes {
+  static const int kTypeCount = 18;
+  static const int kBlockSize = 5;
+  static const int kMaxPointsCount = 5;
+  static const Messages::BoardType::Pieces kMessageType = Messages::BoardType::PENTOMINOS;
+
+  static constexpr bool Cell(int type, int x, int y) {
+    return PieceSetGenerator::DrawingCell(PieceDrawings::kPentominos[type][y], x);
+  }
+};
+
+// The tetraminos followed by the pentominos
+struct MixedShapes {
+  static const int kTypeCount = TetraminoShapes::kTypeCount + PentominoShapes::kTypeCount;
+  static const int kBlockSize = PentominoShapes::kBlockSize;
+  static const int kMaxPointsCount = PentominoShapes::kMaxPointsCount;
+  static const Messages::BoardType::Pieces kMessageType = Messages::BoardType::MIXED;
+
+  static constexpr bool Cell(int type, int x, int y) {
+    return type < TetraminoShapes::kTypeCount
+        ? x < TetraminoShapes::kBlockSize && y < TetraminoShapes::kBlockSize &&
+          TetraminoShapes::Cell(type, x, y)
+        : PentominoShapes::Cell(type - TetraminoShapes::kTypeCount, x, y);
+  }
+};
+
+typedef GeneratedPieceSet<PentominoShapes> PentominoSet;
+typedef GeneratedPieceSet<MixedShapes> MixedSet;
+
+#endif // PIECESET_H
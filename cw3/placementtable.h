@@ -0,0 +1,108 @@
+#ifndef PLACEMENTTABLE_H
+#define PLACEMENTTABLE_H
+
+#include "tetramino.h"
+
+#include <algorithm>
+#include <vector>
+#include <cassert>
+
+// One place a piece can be dropped
+struct Placement {
+  int orientation;
+  int x;
+  int width;
+  int height;
+
+  // The y offset of the lowest point in each column, see Polyomino::Bottom
+  const int* bottom;
+};
+
+// Every distinct place a piece can be dropped on a board of a given width, as
+// one flat list per piece type.  Orientations with the same shape as an
+// earlier orientation of the same type are left out, so nothing is searched
+// twice.  Placements are in order of orientation then x.
+template <typename PieceType>
+class PlacementTable {
+ public:
+  typedef ::Placement Placement;
+
+  PlacementTable() : width_(0) {}
+
+  // Rebuilds the table for a board this wide
+  void SetWidth(int width);
+  int Width() const { return width_; }
+
+  const Placement* Begin(const PieceType& tetramino) const {
+    return placements_.data() + offsets_[tetramino.Type()];
+  }
+  const Placement* End(const PieceType& tetramino) const {
+    return placements_.data() + offsets_[tetramino.Type() + 1];
+  }
+
+  // The number of distinct orientations of each type
+  static int DistinctOrientationCount(int type);
+
+ private:
+  // Whether an earlier orientation of the same type has this shape.  Points
+  // are stored column by column, so the same shape has the same points.
+  static bool IsDuplicate(int type, int orientation);
+
+  int width_;
+  std::vector<Placement> placements_;
+  int offsets_[PieceType::kTypeCount + 1];
+};
+
+template <typename PieceType>
+void PlacementTable<PieceType>::SetWidth(int width) {
+  width_ = width;
+  placements_.clear();
+
+  PieceType tetramino;
+  for (int type=0 ; type<PieceType::kTypeCount ; ++type) {
+    offsets_[type] = placements_.size();
+    tetramino.InitFrom(type);
+
+    for (int orientation=0 ; orientation<tetramino.OrientationCount() ; ++orientation) {
+      if (IsDuplicate(type, orientation))
+        continue;
+
+      Placement placement;
+      placement.orientation = orientation;
+      placement.width = tetramino.Size(orientation).width();
+      placement.height = tetramino.Size(orientation).height();
+      placement.bottom = tetramino.Bottom(orientation);
+
+      for (int x=0 ; x<=width - placement.width ; ++x) {
+        placement.x = x;
+        placements_.push_back(placement);
+      }
+    }
+  }
+  offsets_[PieceType::kTypeCount] = placements_.size();
+}
+
+template <typename PieceType>
+int PlacementTable<PieceType>::DistinctOrientationCount(int type) {
+  int count = 0;
+  for (int orientation=0 ; orientation<PieceType::OrientationCount(type) ; ++orientation) {
+    if (!IsDuplicate(type, orientation))
+      count ++;
+  }
+  return count;
+}
+
+template <typename PieceType>
+bool PlacementTable<PieceType>::IsDuplicate(int type, int orientation) {
+  PieceType tetramino;
+  tetramino.InitFrom(type);
+
+  const Int2* points = tetramino.Points(orientation);
+  for (int other=0 ; other<orientation ; ++other) {
+    if (std::equal(points, points + tetramino.PointsCount(), tetramino.Points(other)))
+      return true;
+  }
+  return false;
+}
+
+#endif // PLACEMENTTABLE_H
@@ -20,12 +20,16 @@ class Population {
   void InitRandom();
 
   IndividualType& operator[](int i) { return individuals_[i]; }
+  const IndividualType& operator[](int i) const { return individuals_[i]; }
   IndividualType& SelectFitnessProportionate(const IndividualType& excluding = IndividualType());
 
   IndividualType& Fittest();
   IndividualType& LeastFit();
   uint64_t MeanFitness() const;
 
+  // The number of individuals whose fitness is an estimate from a censored game
+  int CensoredCount() const;
+
   template <typename ChromosomeAccessor>
   double Diversity(const ChromosomeAccessor& accessor) const;
 
@@ -85,6 +89,16 @@ uint64_t Population<IndividualType>::MeanFitness() const {
   return total_fitness / individuals_.size();
 }
 
+template <typename IndividualType>
+int Population<IndividualType>::CensoredCount() const {
+  int count = 0;
+  for (auto it = individuals_.begin() ; it != individuals_.end() ; ++it) {
+    if (it->FitnessCensored())
+      count ++;
+  }
+  return count;
+}
+
 template <typename IndividualType>
 template <typename ChromosomeAccessor>
 double Population<IndividualType>::Diversity(
@@ -157,6 +171,7 @@ void Population<IndividualType>::NextGeneration() {
     IndividualType child;
     child.Crossover(parent1, parent2);
     child.Mutate();
+    child.SetExpectedFitness((parent1.Fitness() + parent2.Fitness()) / 2);
 
     // Put the child into the new population
     new_population.Replace(i, child);
@@ -0,0 +1,44 @@
+#ifndef RATINGCACHE_H
+#define RATINGCACHE_H
+
+#include "directmappedtable.h"
+#include "utilities.h"
+
+#include <cstdint>
+
+// Remembers the ratings a player gave to boards after a piece was placed, so
+// an afterstate that's reached more than once is only analysed once.
+class RatingCache {
+ public:
+  // Rounded up to a power of 2.  Zero disables the cache.
+  void SetSize(int size) { table_.SetSize(size); }
+  bool Enabled() const { return table_.Enabled(); }
+
+  // The key for a board hash and the other things a rating depends on
+  static uint64_t Key(uint64_t board_hash, int landing_height, int removed_lines);
+
+  bool Find(uint64_t key, double* rating) const;
+  void Insert(uint64_t key, double rating) { table_.Insert(key, rating); }
+
+ private:
+  DirectMappedTable<double> table_;
+};
+
+inline uint64_t RatingCache::Key(uint64_t board_hash, int landing_height, int removed_lines) {
+  // Use keys well away from the ones used for the cells and by
+  // TranspositionTable
+  const uint64_t kRatingKeys = uint64_t(1) << 48;
+  return board_hash ^ Utilities::ZobristKey(
+      kRatingKeys + (uint64_t(landing_height) << 16) + removed_lines);
+}
+
+inline bool RatingCache::Find(uint64_t key, double* rating) const {
+  const double* found = table_.Find(key);
+  if (!found)
+    return false;
+
+  *rating = *found;
+  return true;
+}
+
+#endif // RATINGCACHE_H
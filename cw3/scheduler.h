@@ -0,0 +1,198 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <QtConcurrentMap>
+#include <QMutex>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <vector>
+#include <cstdint>
+#include <sys/time.h>
+
+#include <boost/bind.hpp>
+
+// Runs a batch of jobs on the global thread pool, longest first.  The jobs
+// are sorted by their expected cost and dealt out in turn to one deque per
+// thread.  Each thread works through its own deque from the long end, and
+// when that's empty it steals the shortest job from the deque with the most
+// work left.  That way the stragglers all start straight away and the short
+// jobs fill the gaps around them.  Results are passed back as each job
+// finishes, so what one job finds out can reorder the jobs still waiting.
+template <typename Job, typename Result>
+class Scheduler {
+ public:
+  typedef Result (*Function)(const Job&);
+
+  // Called with each job's index and result as soon as it finishes, on the
+  // thread that ran it.  Only one callback runs at a time.
+  typedef std::function<void (int job, const Result& result)> Callback;
+
+  explicit Scheduler(int threads) : threads_(std::max(threads, 1)), busy_usec_(0), wall_usec_(0) {}
+
+  // Calls function on every job and returns the results in the same order as
+  // the jobs.  costs are only compared with each other.
+  std::vector<Result> Run(const std::vector<Job>& jobs, const std::vector<uint64_t>& costs,
+                          Function function, const Callback& done = Callback());
+
+  // Changes the cost of a job that hasn't started yet and moves it to its new
+  // place in its thread's deque.  Does nothing to jobs that have started.
+  // Only call this from the callback.
+  void Reprioritise(int job, uint64_t cost);
+
+  // The time the threads spent running jobs in the last Run, divided by the
+  // time they could have spent.  1 is perfect.
+  double LoadBalance() const {
+    return wall_usec_ ? double(busy_usec_) / (double(wall_usec_) * threads_) : 1.0;
+  }
+  uint64_t BusyMicroseconds() const { return busy_usec_; }
+  uint64_t CapacityMicroseconds() const { return wall_usec_ * threads_; }
+
+ private:
+  // Runs jobs for one thread until there are none left anywhere
+  void Work(int thread);
+
+  // The next job for a thread, or -1 if there aren't any left
+  int Take(int thread);
+
+  static uint64_t Now();
+
+  const int threads_;
+
+  const std::vector<Job>* jobs_;
+  Function function_;
+  Callback done_;
+  std::vector<Result> results_;
+
+  // Indexes of the jobs waiting for each thread, longest first.  The mutex
+  // guards these, how much work is left in each, the costs, which deque
+  // each job is waiting in (-1 once it's started), busy_usec_ and the
+  // callback.
+  QMutex mutex_;
+  std::vector<std::deque<int> > queues_;
+  std::vector<uint64_t> queued_cost_;
+  std::vector<uint64_t> costs_;
+  std::vector<int> queue_of_;
+
+  uint64_t busy_usec_;
+  uint64_t wall_usec_;
+};
+
+template <typename Job, typename Result>
+std::vector<Result> Scheduler<Job, Result>::Run(const std::vector<Job>& jobs,
+                                                const std::vector<uint64_t>& costs,
+                                                Function function,
+                                                const Callback& done) {
+  jobs_ = &jobs;
+  costs_ = costs;
+  function_ = function;
+  done_ = done;
+  results_.assign(jobs.size(), Result());
+  busy_usec_ = 0;
+
+  // Longest first.  Equal costs keep their order, so the first generation,
+  // where nothing is known yet, runs in population order.
+  std::vector<int> order(jobs.size());
+  for (size_t i=0 ; i<order.size() ; ++i)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(),
+                   [&costs](int a, int b) { return costs[a] > costs[b]; });
+
+  queues_.assign(threads_, std::deque<int>());
+  queued_cost_.assign(threads_, 0);
+  queue_of_.assign(jobs.size(), -1);
+  for (size_t i=0 ; i<order.size() ; ++i) {
+    queues_[i % threads_].push_back(order[i]);
+    queue_of_[order[i]] = i % threads_;
+    queued_cost_[i % threads_] += costs[order[i]];
+  }
+
+  std::vector<int> threads(threads_);
+  for (int i=0 ; i<threads_ ; ++i)
+    threads[i] = i;
+
+  const uint64_t start = Now();
+  QtConcurrent::blockingMap(threads, boost::bind(&Scheduler::Work, this, _1));
+  wall_usec_ = Now() - start;
+  done_ = Callback();
+
+  std::vector<Result> results;
+  results.swap(results_);
+  return results;
+}
+
+template <typename Job, typename Result>
+void Scheduler<Job, Result>::Work(int thread) {
+  uint64_t busy = 0;
+  for (int job ; (job = Take(thread)) != -1 ; ) {
+    const uint64_t start = Now();
+    results_[job] = function_((*jobs_)[job]);
+    busy += Now() - start;
+
+    if (done_) {
+      QMutexLocker locker(&mutex_);
+      done_(job, results_[job]);
+    }
+  }
+
+  QMutexLocker locker(&mutex_);
+  busy_usec_ += busy;
+}
+
+template <typename Job, typename Result>
+int Scheduler<Job, Result>::Take(int thread) {
+  QMutexLocker locker(&mutex_);
+
+  int queue = thread;
+  bool steal = false;
+  if (queues_[thread].empty()) {
+    queue = -1;
+    for (int i=0 ; i<threads_ ; ++i) {
+      if (queues_[i].empty())
+        continue;
+      if (queue == -1 || queued_cost_[i] > queued_cost_[queue] ||
+          (queued_cost_[i] == queued_cost_[queue] && queues_[i].size() > queues_[queue].size()))
+        queue = i;
+    }
+    if (queue == -1)
+      return -1;
+    steal = true;
+  }
+
+  std::deque<int>& jobs = queues_[queue];
+  const int job = steal ? jobs.back() : jobs.front();
+  if (steal)
+    jobs.pop_back();
+  else
+    jobs.pop_front();
+  queued_cost_[queue] -= costs_[job];
+  queue_of_[job] = -1;
+  return job;
+}
+
+template <typename Job, typename Result>
+void Scheduler<Job, Result>::Reprioritise(int job, uint64_t cost) {
+  const int queue = queue_of_[job];
+  if (queue == -1)
+    return;
+
+  std::deque<int>& jobs = queues_[queue];
+  jobs.erase(std::find(jobs.begin(), jobs.end(), job));
+  queued_cost_[queue] = queued_cost_[queue] - costs_[job] + cost;
+  costs_[job] = cost;
+
+  // After any jobs that cost the same, as in Run
+  auto position = std::find_if(jobs.begin(), jobs.end(),
+                               [this, cost](int other) { return costs_[other] < cost; });
+  jobs.insert(position, job);
+}
+
+template <typename Job, typename Result>
+uint64_t Scheduler<Job, Result>::Now() {
+  timeval tv;
+  gettimeofday(&tv, NULL);
+  return uint64_t(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+#endif // SCHEDULER_H
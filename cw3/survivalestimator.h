@@ -0,0 +1,161 @@
+#ifndef SURVIVALESTIMATOR_H
+#define SURVIVALESTIMATOR_H
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <math.h>
+#include <cstdint>
+
+// Estimates how many more blocks a game will last from how close its pile has
+// been getting to the top.  The game gives each block a danger level, and
+// the levels of the last window blocks above their median are fitted with a
+// geometric tail.  The chance of a block reaching the level where the game
+// ends is read off that, treating each block as an independent chance of
+// the game ending with the sample size cut down by how correlated
+// neighbouring blocks are.
+class SurvivalEstimator {
+ public:
+  SurvivalEstimator() : window_(0), death_level_(0), count_(0) {}
+
+  // Forgets every block.  The estimate uses the last window blocks, and a
+  // game ends once its danger level reaches death_level.
+  void Reset(int window, int death_level);
+
+  void AddBlock(int level);
+
+  // The danger levels in the window, oldest first.  Adding them to a freshly
+  // reset estimator puts it back in the same state.
+  void Levels(std::vector<int>* levels) const;
+
+  // Whether a whole window of blocks has been seen
+  bool Ready() const { return count_ >= uint64_t(window_) && window_ > 0; }
+
+  // The expected number of blocks left and a 95% interval around it.  Any of
+  // them can be infinity if nothing in the window came close to the top.
+  void Estimate(double* expected, double* lower, double* upper) const;
+
+ private:
+  int window_;
+  int death_level_;
+  uint64_t count_;
+
+  // The danger level of the last window blocks, oldest at count_ % window_
+  std::vector<uint16_t> levels_;
+
+  // How many blocks in the window are at each danger level
+  std::vector<int> histogram_;
+};
+
+inline void SurvivalEstimator::Reset(int window, int death_level) {
+  window_ = window;
+  death_level_ = death_level;
+  count_ = 0;
+  levels_.assign(window, 0);
+  histogram_.assign(death_level + 1, 0);
+}
+
+inline void SurvivalEstimator::AddBlock(int level) {
+  if (window_ <= 0)
+    return;
+
+  level = std::min(std::max(level, 0), death_level_);
+  uint16_t& slot = levels_[count_ % window_];
+  if (count_ >= uint64_t(window_))
+    histogram_[slot] --;
+  slot = level;
+  histogram_[level] ++;
+  count_ ++;
+}
+
+inline void SurvivalEstimator::Levels(std::vector<int>* levels) const {
+  levels->clear();
+  const uint64_t n = std::min(count_, uint64_t(std::max(window_, 0)));
+  for (uint64_t i=count_ - n ; i<count_ ; ++i)
+    levels->push_back(levels_[i % window_]);
+}
+
+inline void SurvivalEstimator::Estimate(double* expected, double* lower, double* upper) const {
+  const double kInfinity = std::numeric_limits<double>::infinity();
+  const int n = std::min(count_, uint64_t(window_));
+  if (n < 2) {
+    *expected = *lower = *upper = kInfinity;
+    return;
+  }
+
+  // Lag one autocorrelation, for the number of effectively independent blocks
+  double mean = 0.0;
+  for (int level=0 ; level<=death_level_ ; ++level)
+    mean += double(level) * histogram_[level];
+  mean /= n;
+
+  const uint64_t oldest = count_ - n;
+  double variance = 0.0;
+  double covariance = 0.0;
+  double previous = levels_[oldest % window_] - mean;
+  variance += previous * previous;
+  for (uint64_t i=oldest + 1 ; i<count_ ; ++i) {
+    const double current = levels_[i % window_] - mean;
+    variance += current * current;
+    covariance += current * previous;
+    previous = current;
+  }
+  const double rho = variance > 0.0 ? std::min(std::max(covariance / variance, 0.0), 0.99) : 0.0;
+  const double correlation_time = (1.0 + rho) / (1.0 - rho);
+  const double n_eff = n / correlation_time;
+
+  // The median danger level is where the tail starts
+  int median = 0;
+  for (int cumulative=0 ; ; ++median) {
+    cumulative += histogram_[median];
+    if (2 * cumulative >= n)
+      break;
+  }
+
+  double hazard = 0.0;
+  double log_variance = 0.0;
+  if (median >= death_level_ - 1) {
+    // Already close enough to the top that no extrapolation is needed
+    const double p = double(histogram_[death_level_] + histogram_[death_level_ - 1]) / n;
+    hazard = std::max(p, 1.0 / n);
+    log_variance = (1.0 - hazard) / (hazard * n_eff);
+  } else {
+    int exceeding = 0;
+    double excess = 0.0;
+    for (int level=median + 1 ; level<=death_level_ ; ++level) {
+      exceeding += histogram_[level];
+      excess += double(level - median) * histogram_[level];
+    }
+
+    // P(level >= median + k) = p * q^(k-1) for k >= 1
+    const int steps = death_level_ - median - 1;
+    if (exceeding == 0) {
+      *expected = *upper = kInfinity;
+      *lower = n_eff / 3.0;
+      return;
+    }
+    const double p = double(exceeding) / n;
+    const double q = 1.0 - exceeding / excess;
+    if (q <= 0.0) {
+      // Nothing ever got more than one level above the median, so bound the
+      // tail by the most it could be and still look like that
+      const double q_upper = std::min(3.0 / (exceeding / correlation_time), 1.0);
+      *expected = *upper = kInfinity;
+      *lower = 1.0 / (p * pow(q_upper, steps));
+      return;
+    }
+
+    hazard = p * pow(q, steps);
+    const double exceeding_eff = exceeding / correlation_time;
+    const double p_variance = p * (1.0 - p) / n_eff;
+    const double q_variance = q * (1.0 - q) * (1.0 - q) / exceeding_eff;
+    log_variance = p_variance / (p * p) + double(steps) * steps * q_variance / (q * q);
+  }
+
+  const double spread = exp(1.96 * sqrt(log_variance));
+  *expected = 1.0 / hazard;
+  *lower = 1.0 / std::min(hazard * spread, 1.0);
+  *upper = 1.0 / (hazard / spread);
+}
+
+#endif // SURVIVALESTIMATOR_H
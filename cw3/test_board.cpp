@@ -37,8 +37,8 @@ void Board::GetAndSet() {
   }
 
   // Set 2 cells
-  board_->Cell(1,1) = true;
-  (*board_)(2,2) = true;
+  board_->SetCell(1, 1, true);
+  board_->SetCell(2, 2, true);
 
   QCOMPARE(board_->Cell(1,1), true);
   QCOMPARE(board_->Cell(2,2), true);
@@ -57,19 +57,19 @@ void Board::ClearRows() {
   // XXXX
   // __X_
 
-  board_->Cell(0, 0) = true;
-  board_->Cell(1, 0) = true;
-  board_->Cell(2, 0) = true;
-  board_->Cell(3, 0) = true;
+  board_->SetCell(0, 0, true);
+  board_->SetCell(1, 0, true);
+  board_->SetCell(2, 0, true);
+  board_->SetCell(3, 0, true);
 
-  board_->Cell(1, 1) = true;
+  board_->SetCell(1, 1, true);
 
-  board_->Cell(0, 2) = true;
-  board_->Cell(1, 2) = true;
-  board_->Cell(2, 2) = true;
-  board_->Cell(3, 2) = true;
+  board_->SetCell(0, 2, true);
+  board_->SetCell(1, 2, true);
+  board_->SetCell(2, 2, true);
+  board_->SetCell(3, 2, true);
 
-  board_->Cell(2, 3) = true;
+  board_->SetCell(2, 3, true);
 
   QCOMPARE(board_->ClearRows(), 2);
 
@@ -89,29 +89,63 @@ void Board::ClearRows() {
   QCOMPARE(board_->ClearRows(), 0);
 }
 
+void Board::ColumnHeight() {
+  QCOMPARE(board_->ColumnHeight(0), 0);
+
+  // ____
+  // _X__
+  // ____
+  // XX__
+  board_->SetCell(0, 3, true);
+  board_->SetCell(1, 1, true);
+  board_->SetCell(1, 3, true);
+
+  QCOMPARE(board_->ColumnHeight(0), 1);
+  QCOMPARE(board_->ColumnHeight(1), 3);
+  QCOMPARE(board_->ColumnHeight(2), 0);
+
+  // XXXX
+  // _X__
+  // ____
+  // XX__
+  board_->SetCell(0, 0, true);
+  board_->SetCell(1, 0, true);
+  board_->SetCell(2, 0, true);
+  board_->SetCell(3, 0, true);
+
+  QCOMPARE(board_->ColumnHeight(3), 4);
+
+  // The top row is cleared and the columns shrink
+  QCOMPARE(board_->ClearRows(), 1);
+  QCOMPARE(board_->ColumnHeight(0), 1);
+  QCOMPARE(board_->ColumnHeight(1), 3);
+  QCOMPARE(board_->ColumnHeight(2), 0);
+  QCOMPARE(board_->ColumnHeight(3), 0);
+}
+
 void Board::PileHeight() {
   // ____
   // _X__
   // _X_X
   // _X_X
-  board_->Cell(1,1) = true;
-  board_->Cell(1,2) = true;
-  board_->Cell(1,3) = true;
+  board_->SetCell(1, 1, true);
+  board_->SetCell(1, 2, true);
+  board_->SetCell(1, 3, true);
 
-  board_->Cell(3,2) = true;
-  board_->Cell(3,3) = true;
+  board_->SetCell(3, 2, true);
+  board_->SetCell(3, 3, true);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.pile_height, 3);
 
   // Knock off the top one
-  board_->Cell(1,1) = false;
+  board_->SetCell(1, 1, false);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.pile_height, 2);
 
   // Knock off another
-  board_->Cell(1,2) = false;
+  board_->SetCell(1, 2, false);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.pile_height, 2);
@@ -122,8 +156,8 @@ void Board::Holes() {
   // ____
   // ____
   // __X_
-  board_->Cell(1,0) = true;
-  board_->Cell(2,3) = true;
+  board_->SetCell(1, 0, true);
+  board_->SetCell(2, 3, true);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.holes, 3);
@@ -133,7 +167,7 @@ void Board::Holes() {
   // __X_
   // ____
   // __X_
-  board_->Cell(2,1) = true;
+  board_->SetCell(2, 1, true);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.holes, 4);
@@ -145,10 +179,10 @@ void Board::AltitudeDifference() {
   // _X__
   // ____
   // X_XX
-  board_->Cell(0,3) = true;
-  board_->Cell(1,1) = true;
-  board_->Cell(2,3) = true;
-  board_->Cell(3,3) = true;
+  board_->SetCell(0, 3, true);
+  board_->SetCell(1, 1, true);
+  board_->SetCell(2, 3, true);
+  board_->SetCell(3, 3, true);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.altitude_difference, 2);
@@ -157,7 +191,7 @@ void Board::AltitudeDifference() {
   // _X__
   // ____
   // X_XX
-  board_->Cell(1,0) = true;
+  board_->SetCell(1, 0, true);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.altitude_difference, 3);
@@ -166,9 +200,9 @@ void Board::AltitudeDifference() {
   // _X__
   // ____
   // ____
-  board_->Cell(0,3) = false;
-  board_->Cell(2,3) = false;
-  board_->Cell(3,3) = false;
+  board_->SetCell(0, 3, false);
+  board_->SetCell(2, 3, false);
+  board_->SetCell(3, 3, false);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.altitude_difference, 4);
@@ -179,9 +213,9 @@ void Board::WellDepth() {
   // ____
   // ____
   // ____
-  board_->Cell(1,0) = true;
-  board_->Cell(2,0) = true;
-  board_->Cell(3,0) = true;
+  board_->SetCell(1, 0, true);
+  board_->SetCell(2, 0, true);
+  board_->SetCell(3, 0, true);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.max_well_depth, 4);
@@ -192,14 +226,14 @@ void Board::WellDepth() {
   // X_XX
   // X_XX
   board_->Clear();
-  board_->Cell(0,1) = true;
-  board_->Cell(3,1) = true;
-  board_->Cell(0,2) = true;
-  board_->Cell(2,2) = true;
-  board_->Cell(3,2) = true;
-  board_->Cell(0,3) = true;
-  board_->Cell(2,3) = true;
-  board_->Cell(3,3) = true;
+  board_->SetCell(0, 1, true);
+  board_->SetCell(3, 1, true);
+  board_->SetCell(0, 2, true);
+  board_->SetCell(2, 2, true);
+  board_->SetCell(3, 2, true);
+  board_->SetCell(0, 3, true);
+  board_->SetCell(2, 3, true);
+  board_->SetCell(3, 3, true);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.max_well_depth, 2);
@@ -209,7 +243,7 @@ void Board::WellDepth() {
   // X_XX
   // X_XX
   // X_XX
-  board_->Cell(2,1) = true;
+  board_->SetCell(2, 1, true);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.max_well_depth, 3);
@@ -221,11 +255,11 @@ void Board::SumOfWells() {
   // _X__
   // _X_X
   // _X_X
-  board_->Cell(1,1) = true;
-  board_->Cell(1,2) = true;
-  board_->Cell(1,3) = true;
-  board_->Cell(3,2) = true;
-  board_->Cell(3,3) = true;
+  board_->SetCell(1, 1, true);
+  board_->SetCell(1, 2, true);
+  board_->SetCell(1, 3, true);
+  board_->SetCell(3, 2, true);
+  board_->SetCell(3, 3, true);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.max_well_depth, 3);
@@ -241,9 +275,9 @@ void Board::TotalBlocks() {
   // _X__
   // ___X
   // ___X
-  board_->Cell(1,1) = true;
-  board_->Cell(3,2) = true;
-  board_->Cell(3,3) = true;
+  board_->SetCell(1, 1, true);
+  board_->SetCell(3, 2, true);
+  board_->SetCell(3, 3, true);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.total_blocks, 3);
@@ -253,7 +287,7 @@ void Board::TotalBlocks() {
   // _X__
   // ___X
   // X__X
-  board_->Cell(0, 3) = true;
+  board_->SetCell(0, 3, true);
 
   board_->Analyse(&stats_);
   QCOMPARE(stats_.total_blocks, 4);
@@ -269,8 +303,8 @@ void Board::Transitions() {
   // ____
   // ____
   // X__X
-  board_->Cell(0, 3) = true;
-  board_->Cell(3, 3) = true;
+  board_->SetCell(0, 3, true);
+  board_->SetCell(3, 3, true);
   board_->Analyse(&stats_);
   QCOMPARE(stats_.column_transitions, 4);
   QCOMPARE(stats_.row_transitions, 8);
@@ -279,7 +313,7 @@ void Board::Transitions() {
   // ____
   // _X__
   // X__X
-  board_->Cell(1, 2) = true;
+  board_->SetCell(1, 2, true);
   board_->Analyse(&stats_);
   QCOMPARE(stats_.column_transitions, 6);
   QCOMPARE(stats_.row_transitions, 10);
@@ -288,8 +322,8 @@ void Board::Transitions() {
   // X___
   // _X__
   // X__X
-  board_->Cell(0, 0) = true;
-  board_->Cell(0, 1) = true;
+  board_->SetCell(0, 0, true);
+  board_->SetCell(0, 1, true);
   board_->Analyse(&stats_);
   QCOMPARE(stats_.column_transitions, 8);
   QCOMPARE(stats_.row_transitions, 10);
@@ -298,7 +332,7 @@ void Board::Transitions() {
   // X___
   // _X__
   // X__X
-  board_->Cell(1, 0) = true;
+  board_->SetCell(1, 0, true);
   board_->Analyse(&stats_);
   QCOMPARE(stats_.column_transitions, 10);
   QCOMPARE(stats_.row_transitions, 10);
@@ -307,13 +341,319 @@ void Board::Transitions() {
   // X___
   // _X__
   // X__X
-  board_->Cell(2, 0) = true;
-  board_->Cell(3, 0) = true;
+  board_->SetCell(2, 0, true);
+  board_->SetCell(3, 0, true);
   board_->Analyse(&stats_);
   QCOMPARE(stats_.column_transitions, 14);
   QCOMPARE(stats_.row_transitions, 8);
 }
 
+void Board::IncrementalStats() {
+  // Type 5 is:
+  //  XXX
+  //   X
+  Tetramino tetramino;
+  tetramino.InitFrom(5);
+  board_->Add(tetramino, 0, 2, 0);
+
+  // Type 0 is the line
+  tetramino.InitFrom(0);
+  board_->Add(tetramino, 3, 0, 1);
+  // ___X
+  // ___X
+  // XXXX
+  // _X_X
+
+  QCOMPARE(board_->ClearRows(), 1);
+  // ____
+  // ___X
+  // ___X
+  // _X_X
+
+  // Build the same board one cell at a time
+  BoardType expected;
+  expected.Clear();
+  expected.SetCell(3, 1, true);
+  expected.SetCell(3, 2, true);
+  expected.SetCell(1, 3, true);
+  expected.SetCell(3, 3, true);
+
+  BoardStats expected_stats;
+  expected.Analyse(&expected_stats);
+  board_->Analyse(&stats_);
+
+  QCOMPARE(stats_.pile_height, expected_stats.pile_height);
+  QCOMPARE(stats_.holes, expected_stats.holes);
+  QCOMPARE(stats_.connected_holes, expected_stats.connected_holes);
+  QCOMPARE(stats_.altitude_difference, expected_stats.altitude_difference);
+  QCOMPARE(stats_.max_well_depth, expected_stats.max_well_depth);
+  QCOMPARE(stats_.sum_well_depth, expected_stats.sum_well_depth);
+  QCOMPARE(stats_.total_blocks, 4);
+  QCOMPARE(stats_.weighted_blocks, 7);
+  QCOMPARE(stats_.row_transitions, expected_stats.row_transitions);
+  QCOMPARE(stats_.column_transitions, expected_stats.column_transitions);
+}
+
+void Board::PlaceAndUndo() {
+  // X___
+  // XXX_
+  board_->SetCell(0, 2, true);
+  board_->SetCell(0, 3, true);
+  board_->SetCell(1, 3, true);
+  board_->SetCell(2, 3, true);
+
+  BoardStats before;
+  board_->Analyse(&before);
+
+  // Type 0 is the line
+  Tetramino tetramino;
+  tetramino.InitFrom(0);
+
+  BoardType::UndoRecord undo;
+  QCOMPARE(board_->Place(tetramino, 3, 0, 1, &undo), 1);
+  // The bottom row is full and is cleared, leaving:
+  // ____
+  // ___X
+  // ___X
+  // X__X
+  QCOMPARE(board_->Cell(3, 0), false);
+  QCOMPARE(board_->Cell(0, 3), true);
+  QCOMPARE(board_->Cell(1, 3), false);
+  QCOMPARE(board_->Cell(3, 3), true);
+
+  board_->Undo(undo);
+
+  for (int y=0 ; y<4 ; ++y) {
+    for (int x=0 ; x<4 ; ++x) {
+      QCOMPARE(board_->Cell(x, y), (y == 2 && x == 0) || (y == 3 && x < 3));
+    }
+  }
+
+  board_->Analyse(&stats_);
+  QCOMPARE(stats_.pile_height, before.pile_height);
+  QCOMPARE(stats_.holes, before.holes);
+  QCOMPARE(stats_.connected_holes, before.connected_holes);
+  QCOMPARE(stats_.total_blocks, before.total_blocks);
+  QCOMPARE(stats_.weighted_blocks, before.weighted_blocks);
+  QCOMPARE(stats_.row_transitions, before.row_transitions);
+  QCOMPARE(stats_.column_transitions, before.column_transitions);
+}
+
+void Board::PlacementStatBounds() {
+  // X___
+  // X_X_
+  // XXX_
+  board_->SetCell(0, 1, true);
+  board_->SetCell(0, 2, true);
+  board_->SetCell(2, 2, true);
+  board_->SetCell(0, 3, true);
+  board_->SetCell(1, 3, true);
+  board_->SetCell(2, 3, true);
+
+  BoardStats before;
+  board_->Analyse(&before);
+
+  // Every placement of every tetramino, including the ones that clear rows,
+  // must have stats within the bounds
+  Tetramino tetramino;
+  for (int type=0 ; type<Tetramino::kTypeCount ; ++type) {
+    tetramino.InitFrom(type);
+
+    int width = 0;
+    int height = 0;
+    for (int orientation=0 ; orientation<tetramino.OrientationCount() ; ++orientation) {
+      width = std::max(width, tetramino.Size(orientation).width());
+      height = std::max(height, tetramino.Size(orientation).height());
+    }
+
+    BoardStats lower;
+    BoardStats upper;
+    board_->PlacementStatBounds(before, tetramino.PointsCount(), width, height,
+                                &lower, &upper);
+
+    for (int orientation=0 ; orientation<tetramino.OrientationCount() ; ++orientation) {
+      for (int x=0 ; x<=4 - tetramino.Size(orientation).width() ; ++x) {
+        const int y = board_->TetraminoHeight(tetramino, x, orientation);
+        if (y < 0)
+          continue;
+
+        BoardType::UndoRecord undo;
+        stats_.removed_lines = board_->Place(tetramino, x, y, orientation, &undo);
+        stats_.landing_height = y + tetramino.Size(orientation).height();
+        board_->Analyse(&stats_);
+        board_->Undo(undo);
+
+        const int* value = &stats_.pile_height;
+        const int* low = &lower.pile_height;
+        const int* high = &upper.pile_height;
+        for ( ; value <= &stats_.column_transitions ; ++value, ++low, ++high) {
+          QVERIFY(*value >= *low);
+          QVERIFY(*value <= *high);
+        }
+      }
+    }
+  }
+}
+
+void Board::StatsBatch() {
+  // X___
+  // XX_X
+  board_->SetCell(0, 2, true);
+  board_->SetCell(0, 3, true);
+  board_->SetCell(1, 3, true);
+  board_->SetCell(3, 3, true);
+  board_->Analyse(&stats_);
+  stats_.removed_lines = 1;
+  stats_.landing_height = 2;
+
+  // Every field is a criterion, including the last
+  QCOMPARE(int(stats_.end() - stats_.begin()), int(BoardStatsBatch<1>::kStatsCount));
+  QCOMPARE(stats_.end()[-1], stats_.column_transitions);
+
+  BoardStatsBatch<10> batch;
+  for (int i=0 ; i<10 ; ++i)
+    batch.Add(stats_);
+  QCOMPARE(batch.size, 10);
+
+  for (int c=0 ; c<BoardStatsBatch<10>::kStatsCount ; ++c) {
+    for (int i=0 ; i<10 ; ++i)
+      QCOMPARE(batch.values[c * BoardStatsBatch<10>::kStride + i], stats_.begin()[c]);
+  }
+}
+
+void Board::Hash() {
+  QCOMPARE(board_->Hash(), uint64_t(0));
+
+  // X___
+  // XXX_
+  board_->SetCell(0, 2, true);
+  board_->SetCell(0, 3, true);
+  board_->SetCell(1, 3, true);
+  board_->SetCell(2, 3, true);
+  const uint64_t hash = board_->Hash();
+
+  // The mirror image:
+  // ___X
+  // _XXX
+  BoardType mirror;
+  mirror.Clear();
+  mirror.SetCell(3, 2, true);
+  mirror.SetCell(3, 3, true);
+  mirror.SetCell(2, 3, true);
+  mirror.SetCell(1, 3, true);
+  QCOMPARE(mirror.Hash(), board_->MirrorHash());
+  QCOMPARE(board_->Hash(), mirror.MirrorHash());
+  QVERIFY(mirror.Hash() != hash);
+
+  // Placing a piece that clears a row changes the hash, undoing it restores it
+  Tetramino tetramino;
+  tetramino.InitFrom(0);
+
+  BoardType::UndoRecord undo;
+  board_->Place(tetramino, 3, 0, 1, &undo);
+  QVERIFY(board_->Hash() != hash);
+
+  BoardType same;
+  same.Clear();
+  same.SetCell(3, 1, true);
+  same.SetCell(3, 2, true);
+  same.SetCell(0, 3, true);
+  same.SetCell(3, 3, true);
+  QCOMPARE(board_->Hash(), same.Hash());
+
+  board_->Undo(undo);
+  QCOMPARE(board_->Hash(), hash);
+}
+
+void Board::RuntimeSize() {
+  TetrisBoard<0, 0> board;
+  board.SetSize(5, 3);
+  QCOMPARE(board.Size(), Int2(5, 3));
+
+  // Type 0 is the line
+  Tetramino tetramino;
+  tetramino.InitFrom(0);
+  QCOMPARE(board.TetraminoHeight(tetramino, 0, 1), -1);
+  QCOMPARE(board.TetraminoHeight(tetramino, 1, 0), 2);
+
+  board.Add(tetramino, 1, 2, 0);
+  board.SetCell(0, 2, true);
+  board.SetCell(0, 1, true);
+  // _____
+  // X____
+  // XXXXX
+  QCOMPARE(board.ClearRows(), 1);
+  QCOMPARE(board.Cell(0, 2), true);
+  QCOMPARE(board.Cell(0, 1), false);
+  QCOMPARE(board.ColumnHeight(0), 1);
+  QCOMPARE(board.ColumnHeight(1), 0);
+
+  board.Analyse(&stats_);
+  QCOMPARE(stats_.pile_height, 1);
+  QCOMPARE(stats_.total_blocks, 1);
+  QCOMPARE(stats_.row_transitions, 6);
+}
+
+void Board::LargeBoard() {
+  // Rows and columns both need more than one 64 bit word
+  TetrisBoard<80, 70> board;
+  board.Clear();
+
+  // Fill the bottom row apart from the last column
+  for (int x=0 ; x<79 ; ++x) {
+    board.SetCell(x, 69, true);
+  }
+  board.SetCell(0, 68, true);
+
+  // Type 0 is the line
+  Tetramino tetramino;
+  tetramino.InitFrom(0);
+  const int y = board.TetraminoHeight(tetramino, 79, 1);
+  QCOMPARE(y, 66);
+
+  board.Add(tetramino, 79, y, 1);
+  QCOMPARE(board.ClearRows(), 1);
+
+  QCOMPARE(board.ColumnHeight(0), 1);
+  QCOMPARE(board.ColumnHeight(1), 0);
+  QCOMPARE(board.ColumnHeight(79), 3);
+
+  board.Analyse(&stats_);
+  QCOMPARE(stats_.pile_height, 3);
+  QCOMPARE(stats_.total_blocks, 4);
+  QCOMPARE(stats_.weighted_blocks, 1 + 1 + 2 + 3);
+}
+
+void Board::Pentominos() {
+  TetrisBoard<5, 6, PentominoSet> board;
+  board.Clear();
+
+  // _____
+  // XXXX_
+  for (int x=0 ; x<4 ; ++x)
+    board.SetCell(x, 5, true);
+
+  // Type 2 is the line
+  Polyomino<PentominoSet> line;
+  line.InitFrom(2);
+  QCOMPARE(board.TetraminoHeight(line, 0, 0), 4);
+  QCOMPARE(board.TetraminoHeight(line, 4, 1), 1);
+
+  // Standing it up in the last column clears the bottom row
+  TetrisBoard<5, 6, PentominoSet>::UndoRecord undo;
+  QCOMPARE(board.Place(line, 4, 1, 1, &undo), 1);
+  for (int y=2 ; y<6 ; ++y)
+    QCOMPARE(board.Cell(4, y), true);
+  QCOMPARE(board.Cell(0, 5), false);
+
+  board.Analyse(&stats_);
+  QCOMPARE(stats_.total_blocks, 4);
+
+  board.Undo(undo);
+  QCOMPARE(board.Cell(4, 5), false);
+  QCOMPARE(board.Cell(0, 5), true);
+}
+
 void Board::TetraminoHeight() {
   // Type 5 is:
   //  XXX
@@ -393,4 +733,50 @@ void Board::TetraminoHeight() {
   QCOMPARE(board_->TetraminoHeight(tetramino, 3, 1), -1);
 }
 
+void Board::TetraminoHeights() {
+  // _X__
+  // ____
+  // ___X
+  // XX_X
+  board_->SetCell(1, 0, true);
+  board_->SetCell(3, 2, true);
+  board_->SetCell(0, 3, true);
+  board_->SetCell(1, 3, true);
+  board_->SetCell(3, 3, true);
+
+  Tetramino tetramino;
+  int heights[4];
+
+  // The batch version should always agree with TetraminoHeight
+  for (int type=0 ; type<::Tetramino::kTypeCount ; ++type) {
+    tetramino.InitFrom(type);
+    for (int o=0 ; o<tetramino.OrientationCount() ; ++o) {
+      board_->TetraminoHeights(tetramino, o, heights);
+      for (int x=0 ; x<=4 - tetramino.Size(o).width() ; ++x) {
+        QCOMPARE(heights[x], board_->TetraminoHeight(tetramino, x, o));
+      }
+    }
+  }
+
+  // So should the version that works from a placement table
+  PlacementTable<Tetramino> placements;
+  placements.SetWidth(4);
+  int placement_heights[::Tetramino::kMaxOrientationCount * 4];
+  for (int type=0 ; type<::Tetramino::kTypeCount ; ++type) {
+    tetramino.InitFrom(type);
+    const Placement* begin = placements.Begin(tetramino);
+    board_->PlacementHeights(begin, placements.End(tetramino), placement_heights);
+    for (const Placement* p = begin ; p != placements.End(tetramino) ; ++p) {
+      QCOMPARE(placement_heights[p - begin], board_->TetraminoHeight(tetramino, p->x, p->orientation));
+    }
+  }
+
+  // Type 3 is the square
+  tetramino.InitFrom(3);
+  board_->TetraminoHeights(tetramino, 0, heights);
+  QCOMPARE(heights[0], -2);
+  QCOMPARE(heights[1], -2);
+  QCOMPARE(heights[2], 0);
+}
+
 } // namespace Test
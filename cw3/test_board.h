@@ -22,6 +22,7 @@ class Board : public QObject {
   void Size();
   void GetAndSet();
   void ClearRows();
+  void ColumnHeight();
 
   void PileHeight();
   void Holes();
@@ -30,8 +31,17 @@ class Board : public QObject {
   void SumOfWells();
   void TotalBlocks();
   void Transitions();
+  void IncrementalStats();
+  void PlaceAndUndo();
+  void PlacementStatBounds();
+  void StatsBatch();
+  void Hash();
+  void RuntimeSize();
+  void LargeBoard();
+  void Pentominos();
 
   void TetraminoHeight();
+  void TetraminoHeights();
 
  private:
   BoardType* board_;
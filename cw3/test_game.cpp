@@ -0,0 +1,130 @@
+#include "test_game.h"
+
+#include <QTest>
+
+namespace Test {
+
+Game::Game()
+{
+}
+
+void Game::init() {
+  // A reasonable player that lasts a few thousand blocks on a small board
+  const int weights[] = {784, 884, 1959, -4956, -267, 53, 608, -164, -379, 50, 685, -82};
+  player_.Clear();
+  player_.set_algorithm(Messages::Player_Algorithm_LINEAR);
+  for (int i=0 ; i<Criteria_Count ; ++i)
+    player_.add_weights(weights[i]);
+
+  request_.Clear();
+  request_.mutable_selector_random()->set_seed(12345);
+
+  old_stopafter_ = FLAGS_stopafter;
+  old_ttmirror_ = FLAGS_ttmirror;
+  FLAGS_stopafter = 2000;
+}
+
+void Game::cleanup() {
+  FLAGS_stopafter = old_stopafter_;
+  FLAGS_ttmirror = old_ttmirror_;
+}
+
+void Game::RandomSelectorRepeats() {
+  SelectorType one;
+  SelectorType two;
+  one.FromMessage(request_);
+  two.FromMessage(request_);
+
+  int pieces[100];
+  for (int i=0 ; i<100 ; ++i) {
+    pieces[i] = one();
+    QVERIFY(pieces[i] >= 0 && pieces[i] < Tetramino::kTypeCount);
+  }
+
+  // Other random numbers being used in between doesn't change the pieces
+  for (int i=0 ; i<100 ; ++i) {
+    Utilities::global_rng();
+    QCOMPARE(two(), pieces[i]);
+  }
+
+  two.Seek(40);
+  QCOMPARE(two.Position(), uint64_t(40));
+  QCOMPARE(two(), pieces[40]);
+}
+
+void Game::RandomSelectorSnapshot() {
+  SelectorType one;
+  one.FromMessage(request_);
+  for (int i=0 ; i<1000 ; ++i)
+    one();
+
+  Messages::GameSnapshot snapshot;
+  one.ToSnapshot(&snapshot);
+  QVERIFY(snapshot.has_selector_state());
+
+  SelectorType two;
+  two.FromMessage(request_);
+  two.FromSnapshot(snapshot);
+
+  // Snapshots without the generator's state replay the pieces instead
+  snapshot.clear_selector_state();
+  SelectorType three;
+  three.FromMessage(request_);
+  three.FromSnapshot(snapshot);
+
+  QCOMPARE(two.Position(), uint64_t(1000));
+  QCOMPARE(three.Position(), uint64_t(1000));
+  for (int i=0 ; i<100 ; ++i) {
+    const int piece = one();
+    QCOMPARE(two(), piece);
+    QCOMPARE(three(), piece);
+  }
+}
+
+void Game::SnapshotResume() {
+  CheckResume(1);
+  CheckResume(500);
+  CheckResume(1234);
+}
+
+void Game::SnapshotResumeMirrored() {
+  FLAGS_ttmirror = true;
+  CheckResume(700);
+}
+
+void Game::CheckResume(int split) {
+  PlayerType player;
+  player.FromMessage(player_);
+
+  SelectorType selector;
+  selector.FromMessage(request_);
+  GameType straight(player, selector);
+  straight.Play();
+
+  SelectorType first_selector;
+  first_selector.FromMessage(request_);
+  GameType first(player, first_selector);
+  first.Start();
+  QVERIFY(!first.Continue(split));
+  QCOMPARE(first.BlocksPlaced(), uint64_t(split));
+
+  std::string data;
+  Messages::GameSnapshot snapshot;
+  first.ToSnapshot(&snapshot);
+  snapshot.SerializeToString(&data);
+  snapshot.Clear();
+  QVERIFY(snapshot.ParseFromString(data));
+
+  SelectorType second_selector;
+  second_selector.FromMessage(request_);
+  GameType second(player, second_selector);
+  second.FromSnapshot(snapshot);
+  QCOMPARE(second.GetBoard().Hash(), first.GetBoard().Hash());
+  QVERIFY(second.Continue(0));
+
+  QVERIFY(straight.BlocksPlaced() > uint64_t(split));
+  QCOMPARE(second.BlocksPlaced(), straight.BlocksPlaced());
+  QCOMPARE(second.GetBoard().Hash(), straight.GetBoard().Hash());
+}
+
+} // namespace Test
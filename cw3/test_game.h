@@ -0,0 +1,45 @@
+#ifndef TEST_GAME_H
+#define TEST_GAME_H
+
+#include <QObject>
+
+#include "game.h"
+#include "individual.h"
+#include "blockselector_random.h"
+
+namespace Test {
+
+class Game : public QObject {
+  Q_OBJECT
+
+ public:
+  Game();
+
+  typedef Individual<RatingAlgorithm_Linear> PlayerType;
+  typedef BlockSelector::Random<Tetramino> SelectorType;
+  typedef ::Game<PlayerType, SelectorType, TetrisBoard<6, 12> > GameType;
+
+ private slots:
+  void init();
+  void cleanup();
+
+  void RandomSelectorRepeats();
+  void RandomSelectorSnapshot();
+  void SnapshotResume();
+  void SnapshotResumeMirrored();
+
+ private:
+  // Plays until the game has placed split blocks, then carries on from a
+  // snapshot in a new game, checking it ends the same way as playing
+  // straight through
+  void CheckResume(int split);
+
+  Messages::Player player_;
+  Messages::GameRequest request_;
+  uint64_t old_stopafter_;
+  bool old_ttmirror_;
+};
+
+} // namespace Test
+
+#endif // TEST_GAME_H
@@ -3,6 +3,12 @@
 #include <QTest>
 #include <QtDebug>
 
+#include <algorithm>
+#include <vector>
+
+#include "data/tetraminos.c"
+#include "placementtable.h"
+
 namespace Test {
 
 Tetramino::Tetramino() {
@@ -20,4 +26,184 @@ void Tetramino::TestFixedCtor() {
   QCOMPARE(other.Type(), 2);
 }
 
+void Tetramino::Bottom() {
+  // Type 5 in orientation 0 is:
+  //   X
+  //  XXX
+  t_.InitFrom(5);
+  QCOMPARE(t_.Bottom(0)[0], 1);
+  QCOMPARE(t_.Bottom(0)[1], 1);
+  QCOMPARE(t_.Bottom(0)[2], 1);
+
+  // Type 0 is the line
+  t_.InitFrom(0);
+  QCOMPARE(t_.Size(1).width(), 1);
+  QCOMPARE(t_.Bottom(1)[0], 3);
+}
+
+void Tetramino::Mirror() {
+  for (int type=0 ; type<::Tetramino::kTypeCount ; ++type) {
+    t_.InitFrom(type);
+    ::Tetramino mirror;
+    mirror.InitFrom(t_.MirrorType());
+    QCOMPARE(mirror.MirrorType(), type);
+
+    for (int o=0 ; o<t_.OrientationCount() ; ++o) {
+      const int mirror_o = t_.MirrorOrientation(o);
+      QCOMPARE(mirror.Size(mirror_o).width(), t_.Size(o).width());
+      QCOMPARE(mirror.MirrorOrientation(mirror_o), o);
+    }
+  }
+
+  // The line is its own mirror image
+  t_.InitFrom(0);
+  QCOMPARE(t_.MirrorType(), 0);
+}
+
+void Tetramino::MatchesImage() {
+  // The tables are constant expressions
+  static_assert(::Tetramino::OrientationCount(0) == 2, "the line has two orientations");
+  static_assert(::Tetramino::Size(0, 1).height() == 4, "the upright line is 4 high");
+
+  QCOMPARE(int(tetraminos_png.width), ::Tetramino::kTypeCount * ::Tetramino::kBlockSize);
+  QCOMPARE(int(tetraminos_png.height), ::Tetramino::kMaxOrientationCount * ::Tetramino::kBlockSize);
+
+  for (int type=0 ; type<::Tetramino::kTypeCount ; ++type) {
+    t_.InitFrom(type);
+
+    int orientation_count = 0;
+    for (int orientation=0 ; orientation<::Tetramino::kMaxOrientationCount ; ++orientation) {
+      // Points in the image are read column by column, the same order as the
+      // tables
+      std::vector<Int2> points;
+      int bottom[::Tetramino::kBlockSize];
+      std::fill(bottom, bottom + ::Tetramino::kBlockSize, -1);
+
+      for (int x=0 ; x<::Tetramino::kBlockSize ; ++x) {
+        for (int y=0 ; y<::Tetramino::kBlockSize ; ++y) {
+          int image_x = type * ::Tetramino::kBlockSize + x;
+          int image_y = orientation * ::Tetramino::kBlockSize + y;
+
+          if (tetraminos_png.pixel_data[image_y * tetraminos_png.width * tetraminos_png.bytes_per_pixel +
+                                        image_x * tetraminos_png.bytes_per_pixel] < 128) {
+            points.push_back(Int2(x, y));
+            bottom[x] = y;
+          }
+        }
+      }
+
+      if (points.empty())
+        break;
+      orientation_count ++;
+
+      QCOMPARE(int(points.size()), ::Tetramino::kMaxPointsCount);
+      QVERIFY(std::equal(points.begin(), points.end(), t_.Points(orientation)));
+      QVERIFY(std::equal(bottom, bottom + ::Tetramino::kBlockSize, t_.Bottom(orientation)));
+      QCOMPARE(t_.Size(orientation).width(), points.back().x() + 1);
+      QCOMPARE(t_.Size(orientation).height(),
+               *std::max_element(bottom, bottom + ::Tetramino::kBlockSize) + 1);
+    }
+
+    QCOMPARE(t_.OrientationCount(), orientation_count);
+  }
+}
+
+void Tetramino::Placements() {
+  PlacementTable< ::Tetramino> table;
+  table.SetWidth(4);
+
+  // The line fits lying down in one place and standing up in four
+  t_.InitFrom(0);
+  QCOMPARE(int(table.End(t_) - table.Begin(t_)), 5);
+  QCOMPARE(table.Begin(t_)[0].orientation, 0);
+  QCOMPARE(table.Begin(t_)[1].orientation, 1);
+  QCOMPARE(table.Begin(t_)[4].x, 3);
+  QCOMPARE(table.Begin(t_)[4].height, 4);
+
+  // The square has one orientation and fits in three places
+  t_.InitFrom(3);
+  QCOMPARE(int(table.End(t_) - table.Begin(t_)), 3);
+
+  // Every orientation in the image is a different shape
+  for (int type=0 ; type<::Tetramino::kTypeCount ; ++type) {
+    QCOMPARE(PlacementTable< ::Tetramino>::DistinctOrientationCount(type),
+             ::Tetramino::OrientationCount(type));
+  }
+
+  // Nothing fits on a board narrower than everything
+  table.SetWidth(0);
+  QVERIFY(table.Begin(t_) == table.End(t_));
+}
+
+void Tetramino::GeneratedTetraminos() {
+  // Tetraminos generated from the drawings have the same shapes as the ones
+  // read from the image, though maybe in a different order
+  typedef GeneratedPieceSet<TetraminoShapes> Generated;
+
+  for (int type=0 ; type<::Tetramino::kTypeCount ; ++type) {
+    QCOMPARE(Generated::OrientationCount(type), TetraminoSet::OrientationCount(type));
+
+    for (int orientation=0 ; orientation<TetraminoSet::OrientationCount(type) ; ++orientation) {
+      const Int2* points = TetraminoSet::Points(type, orientation);
+      bool found = false;
+      for (int other=0 ; other<Generated::OrientationCount(type) ; ++other) {
+        if (std::equal(points, points + TetraminoSet::kMaxPointsCount, Generated::Points(type, other))) {
+          QVERIFY(std::equal(TetraminoSet::Bottom(type, orientation),
+                             TetraminoSet::Bottom(type, orientation) + TetraminoSet::kBlockSize,
+                             Generated::Bottom(type, other)));
+          QCOMPARE(Generated::Size(type, other), TetraminoSet::Size(type, orientation));
+          found = true;
+        }
+      }
+      QVERIFY(found);
+    }
+
+    QCOMPARE(Generated::MirrorType(type), TetraminoSet::MirrorType(type));
+  }
+}
+
+void Tetramino::Pentominos() {
+  static_assert(PentominoSet::kTypeCount == 18, "there are 18 one-sided pentominos");
+
+  const int kOrientationCounts[] = { 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 1, 4, 4, 2, 2 };
+
+  Polyomino<PentominoSet> piece;
+  for (int type=0 ; type<PentominoSet::kTypeCount ; ++type) {
+    piece.InitFrom(type);
+    QCOMPARE(piece.PointsCount(), 5);
+    QCOMPARE(piece.OrientationCount(), kOrientationCounts[type]);
+
+    for (int o=0 ; o<piece.OrientationCount() ; ++o) {
+      Polyomino<PentominoSet> mirror;
+      mirror.InitFrom(piece.MirrorType());
+      QCOMPARE(mirror.MirrorOrientation(piece.MirrorOrientation(o)), o);
+      QCOMPARE(mirror.Size(piece.MirrorOrientation(o)), piece.Size(o));
+    }
+  }
+
+  // Type 2 is the line
+  piece.InitFrom(2);
+  QCOMPARE(piece.Size(0), Int2(5, 1));
+  QCOMPARE(piece.Size(1), Int2(1, 5));
+  QCOMPARE(piece.Bottom(1)[0], 4);
+
+  // F and its mirror image swap
+  piece.InitFrom(0);
+  QCOMPARE(piece.MirrorType(), 1);
+}
+
+void Tetramino::MixedPieces() {
+  Polyomino<MixedSet> piece;
+  for (int type=0 ; type<MixedSet::kTypeCount ; ++type) {
+    piece.InitFrom(type);
+    QCOMPARE(piece.PointsCount(), type < TetraminoSet::kTypeCount ? 4 : 5);
+  }
+
+  // The tetraminos come first, then the pentominos
+  piece.InitFrom(0);
+  QCOMPARE(piece.Size(0), Int2(4, 1));
+  piece.InitFrom(TetraminoSet::kTypeCount + 2);
+  QCOMPARE(piece.Size(0), Int2(5, 1));
+}
+
 } // namespace Test
@@ -15,6 +15,13 @@ class Tetramino : public QObject {
 
  private slots:
   void TestFixedCtor();
+  void Bottom();
+  void Mirror();
+  void MatchesImage();
+  void Placements();
+  void GeneratedTetraminos();
+  void Pentominos();
+  void MixedPieces();
 
  private:
   ::Tetramino t_;
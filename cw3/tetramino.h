@@ -2,62 +2,102 @@
 #define TETRAMINO_H
 
 #include "utilities.h"
+#include "pieceset.h"
 
 #include <cassert>
 
-class Tetramino {
+// One piece from a piece set (see pieceset.h).  The tables all come from the
+// piece set, so this is just the type.
+template <typename Pieces>
+class Polyomino {
  public:
-  Tetramino();
+  typedef Pieces PieceSet;
+
+  Polyomino() {}
 
   void InitFrom(int type) { type_ = type; }
-  void InitFrom(const Tetramino& other) { type_ = other.type_; }
+  void InitFrom(const Polyomino& other) { type_ = other.type_; }
 
   int Type() const { return type_; }
-  int OrientationCount() const { return orientation_count_[type_]; }
-  const Int2* Points(int orientation) const { return DataOffset(type_, orientation, 0); }
-  const Int2& Size(int orientation) const { return SizeOffset(type_, orientation); }
-
-  static const int kTypeCount;
-  static const int kBlockSize;
-  static const int kPointsCount;
+  inline int OrientationCount() const;
+  inline int PointsCount() const;
+  inline const Int2* Points(int orientation) const;
+  inline const Int2& Size(int orientation) const;
+
+  // The y offset of the lowest point in each column of the tetramino
+  inline const int* Bottom(int orientation) const;
+
+  // The type and orientation of this tetramino reflected left to right.  S and
+  // Z swap, as do L and J.
+  int MirrorType() const { return MirrorType(type_); }
+  int MirrorOrientation(int orientation) const { return MirrorOrientation(type_, orientation); }
+
+  // The same as above for a given type.  These are constant expressions, so
+  // code that knows the type at compile time gets the shape folded in.
+  static constexpr int OrientationCount(int type) { return Pieces::OrientationCount(type); }
+  static constexpr int PointsCount(int type) { return Pieces::PointsCount(type); }
+  static constexpr Int2 Point(int type, int orientation, int i) {
+    return Pieces::Points(type, orientation)[i];
+  }
+  static constexpr Int2 Size(int type, int orientation) { return Pieces::Size(type, orientation); }
+  static constexpr int Bottom(int type, int orientation, int x) {
+    return Pieces::Bottom(type, orientation)[x];
+  }
+  static constexpr int MirrorType(int type) { return Pieces::MirrorType(type); }
+  static constexpr int MirrorOrientation(int type, int orientation) {
+    return Pieces::MirrorOrientation(type, orientation);
+  }
+
+  static const int kTypeCount = Pieces::kTypeCount;
+  static const int kMaxOrientationCount = Pieces::kMaxOrientationCount;
+  static const int kBlockSize = Pieces::kBlockSize;
+  static const int kMaxPointsCount = Pieces::kMaxPointsCount;
   static Utilities::_RangeGenerator<int> kTypeRange;
 
  private:
-  Tetramino(const Tetramino&) {}
-  void operator =(const Tetramino&) {}
-
-  void InitStatic();
-
-  inline Int2* DataOffset(int type, int orientation, int i) const;
-  inline Int2& SizeOffset(int type, int orientation) const;
+  Polyomino(const Polyomino&) {}
+  void operator =(const Polyomino&) {}
 
   int type_;
+};
 
-  static Int2* data_;
-  static Int2* size_;
-  static int* orientation_count_;
+typedef Polyomino<TetraminoSet> Tetramino;
 
-  static const int kMaxOrientationCount;
-};
+template <typename Pieces> const int Polyomino<Pieces>::kTypeCount;
+template <typename Pieces> const int Polyomino<Pieces>::kMaxOrientationCount;
+template <typename Pieces> const int Polyomino<Pieces>::kBlockSize;
+template <typename Pieces> const int Polyomino<Pieces>::kMaxPointsCount;
+template <typename Pieces>
+Utilities::_RangeGenerator<int> Polyomino<Pieces>::kTypeRange(0, Pieces::kTypeCount-1);
 
-Int2* Tetramino::DataOffset(int type, int orientation, int i) const {
-  assert(type >= 0 && type < kTypeCount);
-  assert(orientation >= 0 && orientation < orientation_count_[type]);
-  assert(i >= 0 && i < kPointsCount);
+template <typename Pieces>
+int Polyomino<Pieces>::OrientationCount() const {
+  assert(type_ >= 0 && type_ < kTypeCount);
+  return Pieces::OrientationCount(type_);
+}
 
-  return data_ +
-      type * (kMaxOrientationCount * kPointsCount) +
-      orientation * kPointsCount +
-      i;
+template <typename Pieces>
+int Polyomino<Pieces>::PointsCount() const {
+  assert(type_ >= 0 && type_ < kTypeCount);
+  return Pieces::PointsCount(type_);
 }
 
-Int2& Tetramino::SizeOffset(int type, int orientation) const {
-  assert(type >= 0 && type < kTypeCount);
-  assert(orientation >= 0 && orientation < orientation_count_[type]);
+template <typename Pieces>
+const Int2* Polyomino<Pieces>::Points(int orientation) const {
+  assert(orientation >= 0 && orientation < OrientationCount());
+  return Pieces::Points(type_, orientation);
+}
+
+template <typename Pieces>
+const Int2& Polyomino<Pieces>::Size(int orientation) const {
+  assert(orientation >= 0 && orientation < OrientationCount());
+  return Pieces::Size(type_, orientation);
+}
 
-  return *(size_ +
-      type * kMaxOrientationCount +
-      orientation);
+template <typename Pieces>
+const int* Polyomino<Pieces>::Bottom(int orientation) const {
+  assert(orientation >= 0 && orientation < OrientationCount());
+  return Pieces::Bottom(type_, orientation);
 }
 
 #endif // TETRAMINO_H
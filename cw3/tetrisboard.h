@@ -3,11 +3,15 @@
 
 #include "tetramino.h"
 #include "utilities.h"
+#include "bitword.h"
+#include "boardstorage.h"
+#include "placementtable.h"
 #include "messages.pb.h"
 
 #include <algorithm>
-#include <tr1/array>
+#include <vector>
 #include <cassert>
+#include <cstdint>
 
 #ifndef NO_QT_STUFF
 # include <QtDebug>
@@ -30,332 +34,713 @@ struct BoardStats {
   int row_transitions;
   int column_transitions;
 
-  const int* end() const { return &column_transitions; }
+  const int* end() const { return &column_transitions + 1; }
 };
 
-template <int W = 10, int H = 20>
+// The stats of up to N boards, stored one criterion at a time so a whole
+// batch can be rated with vector instructions (see Individual::RateBatch).
+// Batches live in containers that don't honour over-alignment, so there's no
+// alignment promised beyond int's and the kernels load them unaligned.
+template <int N>
+struct BoardStatsBatch {
+  static const int kStatsCount = sizeof(BoardStats) / sizeof(int);
+
+  // Each criterion's values are padded out to a whole number of 8 lane vectors
+  static const int kStride = (N + 7) / 8 * 8;
+
+  BoardStatsBatch() : size(0) {}
+
+  void Clear() { size = 0; }
+  void Add(const BoardStats& stats) {
+    assert(size < N);
+    const int* value = stats.begin();
+    for (int i=0 ; i<kStatsCount ; ++i)
+      values[i * kStride + size] = value[i];
+    size ++;
+  }
+
+  int size;
+  int32_t values[kStatsCount * kStride];
+};
+
+// The board's cells are stored as bitmasks, both row-major with bit x of a row
+// set if the cell at column x is filled, and column-major with bit i of a
+// column set if the cell i rows up from the bottom is filled.  Column heights,
+// holes and column transitions are worked out from the columns with a few bit
+// operations per column.  Boards with up to 128 cells are packed into one or
+// two integers (see BoardStorage::Packed).
+//
+// The stats that are sums over columns or rows are kept up to date by Add and
+// ClearRows, so Analyse only has to look at the column heights.
+//
+// TetrisBoard<0, 0> has its size set at runtime by SetSize, up to kMaxWidth x
+// kMaxHeight.  Use VisitBoardType to pick the right board for a size.
+//
+// Pieces is the piece set (see pieceset.h) that can be played on the board.
+//
+// The board also keeps a Zobrist hash of its filled cells up to date, so
+// positions that have been seen before can be recognised cheaply.
+template <int W = 10, int H = 20, typename Pieces = TetraminoSet>
 class TetrisBoard {
+ private:
+  // The parts of BoardStats that are sums over each column or row
+  struct RunningStats {
+    int holes;
+    int connected_holes;
+    int total_blocks;
+    int weighted_blocks;
+    int row_transitions;
+    int column_transitions;
+  };
+
  public:
   TetrisBoard() {}
 
-  static const int kWidth;
-  static const int kHeight;
-  static Int2 Size() { return Int2(W, H); }
+  typedef Polyomino<Pieces> PieceType;
+  typedef typename BoardStorage::Select<W,H>::Type StorageType;
+  typedef typename StorageType::RowType RowType;
+  typedef typename StorageType::ColumnType ColumnType;
+
+  // Zero for a board sized at runtime
+  static const int kWidth = W;
+  static const int kHeight = H;
+
+  static const int kMaxWidth = BoardStorage::Words<W,H>::kMaxWidth;
+  static const int kMaxHeight = BoardStorage::Words<W,H>::kMaxHeight;
+
+  int Width() const { return cells_.Width(); }
+  int Height() const { return cells_.Height(); }
+  Int2 Size() const { return Int2(Width(), Height()); }
+
+  // Only changes the size of a board sized at runtime.  Clears the board.
+  void SetSize(int width, int height);
 
   void Clear();
   void CopyFrom(const TetrisBoard& other);
 
-  void Add(const Tetramino& tetramino, int x, int y, int orientation);
+  // Fills the board from one bitmask per row, bit x set for a filled cell in
+  // column x as in Row.  Missing rows are left empty.
+  template <typename Iterator>
+  void SetRows(Iterator begin, Iterator end);
+
+  void Add(const PieceType& tetramino, int x, int y, int orientation);
   int ClearRows();
 
-  int TetraminoHeight(const Tetramino& tetramino, int x, int orientation) const;
+  // Everything Undo needs to take a placement back off the board.  Only valid
+  // while the tetramino passed to Place is still alive.
+  class UndoRecord {
+   private:
+    friend class TetrisBoard;
+
+    const PieceType* tetramino_;
+    int x_;
+    int y_;
+    int orientation_;
+    ColumnType cleared_rows_;
+    RunningStats running_;
+    uint64_t hash_;
+  };
+
+  // Does Add then ClearRows, filling in undo so the board can be put back
+  // exactly as it was.  Returns the number of rows cleared.
+  int Place(const PieceType& tetramino, int x, int y, int orientation,
+            UndoRecord* undo);
+
+  // Reverts the last placement that hasn't been undone yet
+  void Undo(const UndoRecord& undo);
+
+  int TetraminoHeight(const PieceType& tetramino, int x, int orientation) const;
+
+  // Does TetraminoHeight for every x position from 0 to Width() - width, in one pass
+  // over the column heights
+  void TetraminoHeights(const PieceType& tetramino, int orientation, int* heights) const;
+
+  // The same for every placement in a list from a PlacementTable
+  void PlacementHeights(const Placement* begin, const Placement* end, int* heights) const;
 
   void Analyse(BoardStats* stats) const;
 
-  inline const bool& Cell(int x, int y) const;
-  inline const bool& operator()(int x, int y) const { return Cell(x, y); }
+  // Bounds on the stats Analyse would give, and on the landing height and
+  // lines removed, after any piece with this many points that's at most this
+  // wide and high is placed.  stats must be this board's own stats.
+  void PlacementStatBounds(const BoardStats& stats, int points, int width, int height,
+                           BoardStats* lower, BoardStats* upper) const;
+
+  inline bool Cell(int x, int y) const;
+  inline bool operator()(int x, int y) const { return Cell(x, y); }
+  RowType Row(int y) const { return cells_.Row(y); }
+  ColumnType Column(int x) const { return cells_.Column(x); }
+
+  // The number of cells from the bottom of the board to the top of the
+  // highest filled cell in column x
+  int ColumnHeight(int x) const { return BitWord::BitLength(cells_.Column(x)); }
+
+  // The Zobrist hash of the filled cells, and the hash the board would have
+  // if it was reflected left to right.  The mirror hash isn't kept up to date
+  // so it is worked out from scratch.
+  uint64_t Hash() const { return hash_; }
+  uint64_t MirrorHash() const;
 
-  static void ToMessage(Messages::BoardType* message);
+  void ToMessage(Messages::BoardType* message) const;
 
 #ifndef QT_NO_DEBUG
   // Only for unit tests that need to set cells explicitly
-  inline bool& Cell(int x, int y);
-  inline bool& operator()(int x, int y) { return Cell(x, y); }
+  inline void SetCell(int x, int y, bool value);
 #endif
 
  private:
   TetrisBoard(const TetrisBoard&) {}
   void operator =(const TetrisBoard&) {}
 
-  inline void SetCell(int x, int y, bool value);
+  // Removes the rows set in a column mask and updates the running stats
+  void RemoveRows(ColumnType rows);
 
-#ifndef QT_NO_DEBUG
-  bool dirty_;
-  void UpdateHighestCells();
-#else
-  void UpdateHighestCells() { }
-#endif
+  // A random key for every cell, shared by all boards of this type
+  static const uint64_t* CellKeys();
+  static uint64_t CellKey(int x, int y) { return CellKeys()[y * kMaxWidth + x]; }
 
-  std::tr1::array<bool, W*H> cells_;
-  std::tr1::array<int, W> highest_cell_;
+  // The hash of the filled cells in rows 0 to last
+  uint64_t HashRows(int last) const;
+
+  // Adds (sign = 1) or removes (sign = -1) a column's or row's contribution to
+  // the running stats
+  void CountColumn(ColumnType column, int sign);
+  void CountRow(RowType row, int sign);
+  void CountAll();
+
+  StorageType cells_;
+  RunningStats running_;
+  uint64_t hash_;
 };
 
-template <int W, int H>
-const int TetrisBoard<W,H>::kWidth = W;
+template <int W, int H, typename P>
+const int TetrisBoard<W,H,P>::kWidth;
 
-template <int W, int H>
-const int TetrisBoard<W,H>::kHeight = H;
+template <int W, int H, typename P>
+const int TetrisBoard<W,H,P>::kHeight;
 
-template <int W, int H>
-const bool& TetrisBoard<W,H>::Cell(int x, int y) const {
-  assert(x >= 0 && x < W);
-  assert(y >= 0 && y < H);
+template <int W, int H, typename P>
+const int TetrisBoard<W,H,P>::kMaxWidth;
 
-  return cells_[y*W + x];
-}
+template <int W, int H, typename P>
+const int TetrisBoard<W,H,P>::kMaxHeight;
 
-template <int W, int H>
-inline void TetrisBoard<W,H>::SetCell(int x, int y, bool value) {
-  assert(x >= 0 && x < W);
-  assert(y >= 0 && y < H);
+template <int W, int H, typename P>
+bool TetrisBoard<W,H,P>::Cell(int x, int y) const {
+  assert(x >= 0 && x < Width());
+  assert(y >= 0 && y < Height());
 
-  cells_[y*W + x] = value;
+  return cells_.Cell(x, y);
 }
 
 #ifndef QT_NO_DEBUG
-template <int W, int H>
-bool& TetrisBoard<W,H>::Cell(int x, int y) {
-  assert(x >= 0 && x < W);
-  assert(y >= 0 && y < H);
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::SetCell(int x, int y, bool value) {
+  assert(x >= 0 && x < Width());
+  assert(y >= 0 && y < Height());
+
+  CountColumn(cells_.Column(x), -1);
+  CountRow(cells_.Row(y), -1);
 
-  dirty_ = true;
-  return cells_[y*W + x];
+  if (cells_.Cell(x, y) != value)
+    hash_ ^= CellKey(x, y);
+  cells_.Set(x, y, value);
+
+  CountColumn(cells_.Column(x), 1);
+  CountRow(cells_.Row(y), 1);
 }
 #endif
 
-template <int W, int H>
-void TetrisBoard<W,H>::Clear() {
-  std::fill(cells_.begin(), cells_.end(), false);
-  std::fill(highest_cell_.begin(), highest_cell_.end(), H);
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::CountColumn(ColumnType column, int sign) {
+  const int height = BitWord::BitLength(column);
+  const int blocks = BitWord::PopCount(column);
+
+  // Every empty cell below the highest filled cell is a hole, and each run
+  // of empty cells with a filled cell above it is a connected hole.
+  const ColumnType empty = ~column & BitWord::LowBits<ColumnType>(height);
+  const int connected_holes = BitWord::PopCount(ColumnType(empty & ~(empty >> 1)));
+
+  // Count changes between vertically adjacent cells from the highest filled
+  // cell down to the floor, which counts as filled.  The top of every column
+  // counts as one transition as well, even if it's empty.
+  int transitions = 1;
+  if (height) {
+    transitions += BitWord::PopCount(ColumnType(
+        (column ^ (column >> 1)) & BitWord::LowBits<ColumnType>(height - 1)));
+    if (!(column & 1))
+      ++ transitions;
+  }
 
-#ifndef QT_NO_DEBUG
-  dirty_ = false;
-#endif
+  running_.holes += sign * (height - blocks);
+  running_.connected_holes += sign * connected_holes;
+  running_.column_transitions += sign * transitions;
+
+  // The block in row i from the bottom is weighted by i+1
+  running_.total_blocks += sign * blocks;
+  running_.weighted_blocks += sign * (blocks + BitWord::WeightedPopCount(column));
 }
 
-template <int W, int H>
-void TetrisBoard<W,H>::CopyFrom(const TetrisBoard& other) {
-  std::copy(other.cells_.begin(), other.cells_.end(), cells_.begin());
-  std::copy(other.highest_cell_.begin(), other.highest_cell_.end(), highest_cell_.begin());
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::CountRow(RowType row, int sign) {
+  // Every cell that differs from its neighbour is a transition.  The walls
+  // either side of the row count as filled cells.
+  int transitions = BitWord::PopCount(RowType(
+      (row ^ (row >> 1)) & BitWord::LowBits<RowType>(Width() - 1)));
+  if (!(row & 1))
+    ++ transitions;
+  if (!(row & (RowType(1) << (Width() - 1))))
+    ++ transitions;
+
+  running_.row_transitions += sign * transitions;
+}
 
-#ifndef QT_NO_DEBUG
-  dirty_ = false;
-#endif
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::CountAll() {
+  running_.holes = 0;
+  running_.connected_holes = 0;
+  running_.total_blocks = 0;
+  running_.weighted_blocks = 0;
+  running_.row_transitions = 0;
+  running_.column_transitions = 0;
+
+  for (int x=0 ; x<Width() ; ++x)
+    CountColumn(cells_.Column(x), 1);
+  for (int y=0 ; y<Height() ; ++y)
+    CountRow(cells_.Row(y), 1);
+}
+
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::SetSize(int width, int height) {
+  cells_.SetSize(width, height);
+  Clear();
+}
+
+template <int W, int H, typename P>
+const uint64_t* TetrisBoard<W,H,P>::CellKeys() {
+  struct Keys {
+    Keys() {
+      for (int i=0 ; i<kMaxWidth * kMaxHeight ; ++i)
+        keys.push_back(Utilities::ZobristKey(i));
+    }
+    std::vector<uint64_t> keys;
+  };
+
+  // Function-local statics are initialised in a thread-safe way
+  static const Keys keys;
+  return &keys.keys[0];
+}
+
+template <int W, int H, typename P>
+uint64_t TetrisBoard<W,H,P>::HashRows(int last) const {
+  uint64_t ret = 0;
+  for (int y=0 ; y<=last ; ++y) {
+    RowType row = cells_.Row(y);
+    while (row) {
+      const int x = BitWord::LowestBit(row);
+      ret ^= CellKey(x, y);
+      row &= ~(RowType(1) << x);
+    }
+  }
+  return ret;
 }
 
-template <int W, int H>
-void TetrisBoard<W,H>::Add(const Tetramino& tetramino, int x, int y, int orientation) {
-  assert(x + tetramino.Size(orientation).width() <= W);
-  assert(y + tetramino.Size(orientation).height() <= H);
+template <int W, int H, typename P>
+uint64_t TetrisBoard<W,H,P>::MirrorHash() const {
+  uint64_t ret = 0;
+  for (int y=0 ; y<Height() ; ++y) {
+    RowType row = cells_.Row(y);
+    while (row) {
+      const int x = BitWord::LowestBit(row);
+      ret ^= CellKey(Width()-1 - x, y);
+      row &= ~(RowType(1) << x);
+    }
+  }
+  return ret;
+}
+
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::Clear() {
+  cells_.Clear();
+  CountAll();
+  hash_ = 0;
+}
+
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::CopyFrom(const TetrisBoard& other) {
+  cells_ = other.cells_;
+  running_ = other.running_;
+  hash_ = other.hash_;
+}
+
+template <int W, int H, typename P>
+template <typename Iterator>
+void TetrisBoard<W,H,P>::SetRows(Iterator begin, Iterator end) {
+  cells_.Clear();
+
+  int y = 0;
+  for (Iterator it = begin ; it != end && y < Height() ; ++it, ++y) {
+    for (int x=0 ; x<Width() ; ++x) {
+      if (uint64_t(*it) & (uint64_t(1) << x))
+        cells_.Set(x, y, true);
+    }
+  }
+
+  CountAll();
+  hash_ = HashRows(Height() - 1);
+}
+
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::Add(const PieceType& tetramino, int x, int y, int orientation) {
+  assert(x + tetramino.Size(orientation).width() <= Width());
+  assert(y + tetramino.Size(orientation).height() <= Height());
   assert(x >= 0 && y >= 0);
 
+  const Int2& size(tetramino.Size(orientation));
+
+  // Take away the old contribution of the columns and rows being changed
+  for (int i=0 ; i<size.width() ; ++i)
+    CountColumn(cells_.Column(x + i), -1);
+  for (int i=0 ; i<size.height() ; ++i)
+    CountRow(cells_.Row(y + i), -1);
+
+  cells_.Add(tetramino, x, y, orientation);
+
   const Int2* point = tetramino.Points(orientation);
-  for (int i=0 ; i<Tetramino::kPointsCount ; ++i) {
-    const int px = x + point->x();
-    const int py = y + point->y();
+  for (int i=0 ; i<tetramino.PointsCount() ; ++i, ++point)
+    hash_ ^= CellKey(x + point->x(), y + point->y());
 
-    assert(!Cell(px, py));
+  for (int i=0 ; i<size.width() ; ++i)
+    CountColumn(cells_.Column(x + i), 1);
+  for (int i=0 ; i<size.height() ; ++i)
+    CountRow(cells_.Row(y + i), 1);
+}
 
-    SetCell(px, py, true);
-    highest_cell_[px] = std::min(highest_cell_[px], py);
+template <int W, int H, typename P>
+int TetrisBoard<W,H,P>::ClearRows() {
+  const ColumnType full_rows = cells_.FullRows();
+  if (!full_rows)
+    return 0;
 
-    point++;
-  }
+  RemoveRows(full_rows);
+  return BitWord::PopCount(full_rows);
 }
 
-template <int W, int H>
-int TetrisBoard<W,H>::ClearRows() {
-  UpdateHighestCells();
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::RemoveRows(ColumnType rows) {
+  // Only the rows down to the lowest removed one change, so only their
+  // cells need hashing again
+  const int last = Height()-1 - BitWord::LowestBit(rows);
+  hash_ ^= HashRows(last);
 
-  int rows_cleared = 0;
+  // Remove all the rows in one go
+  cells_.RemoveRows(rows);
 
-  bool* row_start = cells_.begin();
-  bool* row_end = row_start + W;
+  hash_ ^= HashRows(last);
 
-  // For each row...
-  for ( ; row_start != cells_.end() ; row_start = row_end, row_end += W) {
-    // Decide whether we need to clear the row
-    if (std::find(row_start, row_end, false) != row_end)
-      continue;
+  // Every column has changed.  A full row has no row transitions, and the
+  // empty rows that replace it at the top have two each.
 
-    // Move all the higher rows down one
-    std::copy_backward(cells_.begin(), row_start, row_end);
+  running_.holes = 0;
+  running_.connected_holes = 0;
+  running_.total_blocks = 0;
+  running_.weighted_blocks = 0;
+  running_.column_transitions = 0;
+  for (int x=0 ; x<Width() ; ++x)
+    CountColumn(cells_.Column(x), 1);
 
-    rows_cleared ++;
-  }
+  running_.row_transitions += 2 * BitWord::PopCount(rows);
+}
 
-  if (rows_cleared) {
-    // Clear the new rows at the top
-    std::fill(cells_.begin(), cells_.begin() + W*rows_cleared, false);
-
-    // Update highest_cell_
-    for (int x=0 ; x<W ; ++x) {
-      for (int y=highest_cell_[x]+rows_cleared ; y<=H ; ++y) {
-        if (y == H || Cell(x, y)) {
-          highest_cell_[x] = y;
-          break;
-        }
-      }
-    }
-  }
+template <int W, int H, typename P>
+int TetrisBoard<W,H,P>::Place(const PieceType& tetramino, int x, int y, int orientation,
+                              UndoRecord* undo) {
+  undo->tetramino_ = &tetramino;
+  undo->x_ = x;
+  undo->y_ = y;
+  undo->orientation_ = orientation;
+  undo->running_ = running_;
+  undo->hash_ = hash_;
+
+  Add(tetramino, x, y, orientation);
+
+  undo->cleared_rows_ = cells_.FullRows();
+  if (!undo->cleared_rows_)
+    return 0;
 
-  return rows_cleared;
+  RemoveRows(undo->cleared_rows_);
+  return BitWord::PopCount(undo->cleared_rows_);
 }
 
-template <int W, int H>
-void TetrisBoard<W,H>::Analyse(BoardStats* stats) const {
-  const_cast<TetrisBoard*>(this)->UpdateHighestCells();
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::Undo(const UndoRecord& undo) {
+  // The rows that were cleared must have been full, so they can be put back
+  // without saving their contents
+  if (undo.cleared_rows_)
+    cells_.InsertFullRows(undo.cleared_rows_);
 
-  // Initialise the output variables
-  int holes = 0;
-  int connected_holes = 0;
+  cells_.Remove(*undo.tetramino_, undo.x_, undo.y_, undo.orientation_);
+  running_ = undo.running_;
+  hash_ = undo.hash_;
+}
+
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::Analyse(BoardStats* stats) const {
   int max_well_depth = 0;
   int sum_well_depth = 0;
-  int column_transitions = W;
-  int row_transitions = 0;
-
-  // These we initialise by iterating through highest_cell_;
-  int total_blocks = 0;
-  int weighted_total_blocks = 0;
-  int pile_height = H;
-  int max_pile_height = 0;
-
-  for (auto it = highest_cell_.begin() ; it != highest_cell_.end() ; ++it) {
-    if (*it != H) total_blocks ++;
-    weighted_total_blocks += H - *it;
-    pile_height = std::min(*it, pile_height);
-    max_pile_height = std::max(*it, max_pile_height);
+  int pile_height = 0;
+  int min_pile_height = Height();
+
+  int heights[kMaxWidth];
+  for (int x=0 ; x<Width() ; ++x) {
+    heights[x] = ColumnHeight(x);
   }
-  pile_height = H - pile_height;
-  max_pile_height = H - max_pile_height;
 
   // For each column...
-  for (int x=0 ; x<W ; ++x) {
-    const int highest = highest_cell_[x];
-    int well_depth;
+  for (int x=0 ; x<Width() ; ++x) {
+    const int height = heights[x];
+    pile_height = std::max(pile_height, height);
+    min_pile_height = std::min(min_pile_height, height);
 
     // A well is a narrow 1-cell wide hole that is open from the top.
     // Special cases for the edges of the board.
+    int well_depth;
     if (x == 0) {
-      well_depth = highest - highest_cell_[1];
-    } else if (x == W-1) {
-      well_depth = highest - highest_cell_[x-1];
+      well_depth = heights[1] - height;
+    } else if (x == Width()-1) {
+      well_depth = heights[x-1] - height;
     } else {
-      well_depth = highest - std::max(highest_cell_[x-1], highest_cell_[x+1]);
+      well_depth = std::min(heights[x-1], heights[x+1]) - height;
     }
 
     sum_well_depth += std::max(0, well_depth);
     max_well_depth = std::max(max_well_depth, well_depth);
-
-    // Start at the cell below the highest filled cell and go down.
-    // Keep track of the cell above us.
-    bool cell_above = true;
-    for (int y=highest_cell_[x]+1 ; y<H ; ++y) {
-      const bool cell = Cell(x, y);
-
-      if (cell != cell_above)
-        ++ column_transitions;
-      if (!cell && y==H-1)
-        ++ column_transitions;
-
-      if (cell) {
-        ++ total_blocks;
-        weighted_total_blocks += H - y;
-      } else {
-        // We're in a hole
-        ++ holes;
-
-        // If the one above wasn't a hole as well then this is a new unique
-        // connected hole
-        if (cell_above) {
-          ++ connected_holes;
-        }
-      }
-      cell_above = cell;
-    }
   }
 
-  // For each row...
-  // This loop calculates only row_transitions, and it's not optimised :/
-  for (int y=0 ; y<H ; ++y) {
-    bool last_cell = true;
-    for (int x=0 ; x<W ; ++x) {
-      const bool cell = Cell(x, y);
-
-      if (cell != last_cell)
-        ++ row_transitions;
-
-      last_cell = cell;
-    }
-    if (!last_cell)
-      ++ row_transitions;
-  }
-
-  stats->holes = holes;
-  stats->connected_holes = connected_holes;
+  stats->holes = running_.holes;
+  stats->connected_holes = running_.connected_holes;
   stats->max_well_depth = max_well_depth;
   stats->sum_well_depth = sum_well_depth;
   stats->pile_height = pile_height;
-  stats->altitude_difference = pile_height - max_pile_height;
-  stats->total_blocks = total_blocks;
-  stats->weighted_blocks = weighted_total_blocks;
-  stats->column_transitions = column_transitions;
-  stats->row_transitions = row_transitions;
+  stats->altitude_difference = pile_height - min_pile_height;
+  stats->total_blocks = running_.total_blocks;
+  stats->weighted_blocks = running_.weighted_blocks;
+  stats->column_transitions = running_.column_transitions;
+  stats->row_transitions = running_.row_transitions;
 }
 
-template <int W, int H>
-int TetrisBoard<W,H>::TetraminoHeight(const Tetramino& tetramino,
-                                      int x, int orientation) const {
-  const_cast<TetrisBoard*>(this)->UpdateHighestCells();
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::PlacementStatBounds(const BoardStats& stats,
+                                             int points, int width, int height,
+                                             BoardStats* lower, BoardStats* upper) const {
+  // Only rows with no more empty cells than the piece has points can be
+  // completed, and no more of them than the piece is high
+  int clearable = 0;
+  for (int y=0 ; y<Height() ; ++y) {
+    if (Width() - BitWord::PopCount(cells_.Row(y)) <= points)
+      clearable ++;
+  }
+  const int removed = std::min(clearable, height);
+
+  // No column can end up higher than the piece resting on the highest one.
+  // Removing a row can take a column down to the next filled cell below it,
+  // however far down that is.
+  const int pile = stats.pile_height;
+  const int min_pile = pile - stats.altitude_difference;
+  const int highest = std::min(Height(), pile + height);
+  const int lowest_min = removed ? 0 : min_pile;
+
+  lower->pile_height = removed ? 0 : pile;
+  upper->pile_height = highest;
+  lower->altitude_difference = 0;
+  upper->altitude_difference = highest - lowest_min;
+
+  // The piece lands on the pile, and its lowest point is never below the floor
+  lower->landing_height = Height() - pile;
+  upper->landing_height = Height();
+  lower->removed_lines = 0;
+  upper->removed_lines = removed;
+
+  // The piece can't reach existing holes, so only removing rows can uncover
+  // them.  Each new connected hole has a different point of the piece on top.
+  lower->holes = removed ? 0 : stats.holes;
+  upper->holes = stats.holes + width * highest;
+  lower->connected_holes = removed ? 0 : stats.connected_holes;
+  upper->connected_holes = stats.connected_holes + points;
+
+  // Each column is at most as deep as the highest column.  Placing only
+  // changes the wells in and next to the columns the piece covers.
+  lower->max_well_depth = 0;
+  upper->max_well_depth = highest;
+  if (removed) {
+    lower->sum_well_depth = 0;
+    upper->sum_well_depth = Width() * highest;
+  } else {
+    lower->sum_well_depth = std::max(0, stats.sum_well_depth - (width + 2) * highest);
+    upper->sum_well_depth = stats.sum_well_depth + (width + 2) * highest;
+  }
+
+  // Every block left after removing rows is weighted by at least 1.  The
+  // piece's points all land between the lowest column and the highest.
+  lower->total_blocks = stats.total_blocks + points - Width() * removed;
+  upper->total_blocks = stats.total_blocks + points;
+  if (removed) {
+    lower->weighted_blocks = std::max(0, lower->total_blocks);
+  } else {
+    lower->weighted_blocks = stats.weighted_blocks + points * (min_pile + 1);
+  }
+  upper->weighted_blocks = stats.weighted_blocks + points * highest;
+
+  // Each point placed changes at most two transitions in its row and two in
+  // its column.  A removed row has no row transitions and is replaced by an
+  // empty one with two, and takes away at most two column transitions from
+  // every column.
+  lower->row_transitions = stats.row_transitions - 2 * points;
+  upper->row_transitions = stats.row_transitions + 2 * points + 2 * removed;
+  lower->column_transitions = stats.column_transitions - 2 * points - 2 * Width() * removed;
+  upper->column_transitions = stats.column_transitions + 2 * points;
+}
 
+template <int W, int H, typename P>
+int TetrisBoard<W,H,P>::TetraminoHeight(const PieceType& tetramino,
+                                        int x, int orientation) const {
   const Int2& size(tetramino.Size(orientation));
+  const int* bottom = tetramino.Bottom(orientation);
 
-  // Work out where to start
-  int y_start = *std::min_element(
-      highest_cell_.begin() + x, highest_cell_.begin() + x + size.width()) - size.height();
+  // If the top of the tetramino would be above the board when it's resting on
+  // the highest column it covers, it doesn't fit.
+  int max_height = 0;
+  for (int i=0 ; i<size.width() ; ++i) {
+    max_height = std::max(max_height, ColumnHeight(x + i));
+  }
+  const int y_start = Height() - max_height - size.height();
 
   if (y_start < 0)
     return y_start;
 
-  // "Drop" the tetramino
-  for (int y=y_start ; y<=H - size.height() ; ++y) {
-    // Check to see if any of the points on the tetramino at this position are occupied
-    const Int2* point = tetramino.Points(orientation);
-    for (int i=0 ; i<Tetramino::kPointsCount ; ++i) {
-      if (Cell(x + point->x(), y + point->y())) {
-        return y - 1;
-      }
-      point++;
-    }
+  // "Drop" the tetramino.  It comes to rest on the first column where its
+  // lowest point touches the highest filled cell.
+  int y = Height();
+  for (int i=0 ; i<size.width() ; ++i) {
+    y = std::min(y, Height() - ColumnHeight(x + i) - 1 - bottom[i]);
   }
-  return H - size.height();
+
+  assert(!cells_.Collides(tetramino, x, y, orientation));
+  return y;
 }
 
-template <int W, int H>
-void TetrisBoard<W,H>::ToMessage(Messages::BoardType* message) {
-  message->set_width(W);
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::TetraminoHeights(const PieceType& tetramino,
+                                          int orientation, int* heights) const {
+  const Int2& size(tetramino.Size(orientation));
+  const int* bottom = tetramino.Bottom(orientation);
+
+  int tops[kMaxWidth];
+  for (int x=0 ; x<Width() ; ++x) {
+    tops[x] = Height() - ColumnHeight(x);
+  }
+
+  for (int x=0 ; x<=Width() - size.width() ; ++x) {
+    int highest_top = Height();
+    int y = Height();
+    for (int i=0 ; i<size.width() ; ++i) {
+      highest_top = std::min(highest_top, tops[x + i]);
+      y = std::min(y, tops[x + i] - 1 - bottom[i]);
+    }
+
+    const int y_start = highest_top - size.height();
+    heights[x] = (y_start < 0) ? y_start : y;
+  }
 }
 
-#ifndef QT_NO_DEBUG
-  template <int W, int H>
-  void TetrisBoard<W,H>::UpdateHighestCells() {
-    if (!dirty_)
-      return;
-
-    std::fill(highest_cell_.begin(), highest_cell_.end(), H);
-    for (int x=0 ; x<W ; ++x) {
-      for (int y=0 ; y<H ; ++y) {
-        if (Cell(x, y)) {
-          highest_cell_[x] = y;
-          break;
-        }
-      }
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::PlacementHeights(const Placement* begin,
+                                          const Placement* end,
+                                          int* heights) const {
+  int tops[kMaxWidth];
+  for (int x=0 ; x<Width() ; ++x) {
+    tops[x] = Height() - ColumnHeight(x);
+  }
+
+  for (const Placement* p = begin ; p != end ; ++p) {
+    int highest_top = Height();
+    int y = Height();
+    for (int i=0 ; i<p->width ; ++i) {
+      highest_top = std::min(highest_top, tops[p->x + i]);
+      y = std::min(y, tops[p->x + i] - 1 - p->bottom[i]);
     }
 
-    dirty_ = false;
+    const int y_start = highest_top - p->height;
+    *(heights++) = (y_start < 0) ? y_start : y;
   }
-#endif
+}
+
+template <int W, int H, typename P>
+void TetrisBoard<W,H,P>::ToMessage(Messages::BoardType* message) const {
+  message->set_width(Width());
+  message->set_height(Height());
+}
+
+// The compiled board sizes for a piece set, see VisitBoardType.  Only the
+// tetraminos have any, to keep down the number of games that get compiled.
+template <typename Pieces>
+struct CompiledBoardTypes {
+  template <typename Visitor>
+  static bool Visit(int, int, Visitor) { return false; }
+};
+
+template <>
+struct CompiledBoardTypes<TetraminoSet> {
+  template <typename Visitor>
+  static bool Visit(int width, int height, Visitor visitor) {
+    if (height != width * 2)
+      return false;
+
+    switch (width) {
+      case 5: visitor(static_cast<TetrisBoard<5, 10>*>(NULL)); return true;
+      case 6: visitor(static_cast<TetrisBoard<6, 12>*>(NULL)); return true;
+      case 7: visitor(static_cast<TetrisBoard<7, 14>*>(NULL)); return true;
+      case 8: visitor(static_cast<TetrisBoard<8, 16>*>(NULL)); return true;
+      case 9: visitor(static_cast<TetrisBoard<9, 18>*>(NULL)); return true;
+      case 10: visitor(static_cast<TetrisBoard<10, 20>*>(NULL)); return true;
+
+      // Too big for the runtime sized board
+      case 64: visitor(static_cast<TetrisBoard<64, 128>*>(NULL)); return true;
+    }
+    return false;
+  }
+};
+
+// Calls visitor(static_cast<BoardType*>(NULL)) with the TetrisBoard type to
+// use for a width x height board and a piece set.  The usual sizes have their
+// own compiled versions, anything else up to kMaxWidth x kMaxHeight gets
+// TetrisBoard<0, 0, Pieces> which the visitor must call SetSize on.  Returns
+// false if no board can be that size.
+template <typename Pieces = TetraminoSet, typename Visitor>
+bool VisitBoardType(int width, int height, Visitor visitor) {
+  typedef TetrisBoard<0, 0, Pieces> RuntimeBoard;
+
+  if (CompiledBoardTypes<Pieces>::Visit(width, height, visitor))
+    return true;
+
+  if (width <= 0 || width > RuntimeBoard::kMaxWidth ||
+      height <= 0 || height > RuntimeBoard::kMaxHeight)
+    return false;
+
+  visitor(static_cast<RuntimeBoard*>(NULL));
+  return true;
+}
 
 #ifndef NO_QT_STUFF
-  template <int W, int H>
-  QDebug operator<<(QDebug s, const TetrisBoard<W,H>& b) {
-    s.nospace() << "TetrisBoard(" << b.kWidth << "x" << b.kHeight << ")\n";
+  template <int W, int H, typename P>
+  QDebug operator<<(QDebug s, const TetrisBoard<W,H,P>& b) {
+    s.nospace() << "TetrisBoard(" << b.Width() << "x" << b.Height() << ")\n";
 
-    for (int y=0 ; y<b.kHeight ; ++y) {
+    for (int y=0 ; y<b.Height() ; ++y) {
       QString row;
       row.sprintf("%2d  ", y);
 
-      for (int x=0 ; x<b.kWidth ; ++x) {
+      for (int x=0 ; x<b.Width() ; ++x) {
         row += b(x, y) ? "X" : "_";
       }
       s.nospace() << row.toAscii().constData() << "\n";
@@ -0,0 +1,66 @@
+#ifndef TRANSPOSITIONTABLE_H
+#define TRANSPOSITIONTABLE_H
+
+#include "directmappedtable.h"
+#include "utilities.h"
+
+#include <cstdint>
+
+// Remembers the move Game::Step picked for a board and the two tetraminos it
+// was looking at, so the search doesn't have to be done again when the same
+// position comes round.
+class TranspositionTable {
+ public:
+  // Rounded up to a power of 2.  Zero disables the table.
+  void SetSize(int size) { table_.SetSize(size); }
+  bool Enabled() const { return table_.Enabled(); }
+
+  // The key for a board hash and the types of the current and next piece
+  static uint64_t Key(uint64_t board_hash, int type1, int type2);
+
+  bool Find(uint64_t key, int* x, int* orientation) const;
+  void Insert(uint64_t key, int x, int orientation);
+
+  // Calls function(key, x, orientation) for every entry.  Inserting them all
+  // into an empty table of the same size gives the same table.
+  template <typename Function>
+  void ForEach(Function function) const;
+
+ private:
+  struct Move {
+    int16_t x;
+    int16_t orientation;
+  };
+
+  DirectMappedTable<Move> table_;
+};
+
+inline uint64_t TranspositionTable::Key(uint64_t board_hash, int type1, int type2) {
+  // Use keys well away from the ones used for the board's cells
+  const uint64_t kPieceKeys = uint64_t(1) << 32;
+  return board_hash ^ Utilities::ZobristKey(kPieceKeys + (uint64_t(type1) << 16) + type2);
+}
+
+inline bool TranspositionTable::Find(uint64_t key, int* x, int* orientation) const {
+  const Move* move = table_.Find(key);
+  if (!move)
+    return false;
+
+  *x = move->x;
+  *orientation = move->orientation;
+  return true;
+}
+
+inline void TranspositionTable::Insert(uint64_t key, int x, int orientation) {
+  const Move move = {int16_t(x), int16_t(orientation)};
+  table_.Insert(key, move);
+}
+
+template <typename Function>
+void TranspositionTable::ForEach(Function function) const {
+  table_.ForEach([&function](uint64_t key, const Move& move) {
+    function(key, move.x, move.orientation);
+  });
+}
+
+#endif // TRANSPOSITIONTABLE_H
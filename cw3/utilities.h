@@ -2,6 +2,7 @@
 #define UTILITIES_H
 
 #include <cstdlib>
+#include <cstdint>
 
 #include <boost/random/lagged_fibonacci.hpp>
 #include <boost/random/variate_generator.hpp>
@@ -9,15 +10,15 @@
 // Source-compatibility with QPoint and QSize
 class Int2 {
  public:
-  Int2() {}
-  Int2(int x, int y) : x_(x), y_(y) {}
+  constexpr Int2() : x_(0), y_(0) {}
+  constexpr Int2(int x, int y) : x_(x), y_(y) {}
 
-  int x() const { return x_; }
-  int y() const { return y_; }
-  int width() const { return x_; }
-  int height() const { return y_; }
+  constexpr int x() const { return x_; }
+  constexpr int y() const { return y_; }
+  constexpr int width() const { return x_; }
+  constexpr int height() const { return y_; }
 
-  bool operator == (const Int2& other) const { return x_ == other.x_ && y_ == other.y_; }
+  constexpr bool operator == (const Int2& other) const { return x_ == other.x_ && y_ == other.y_; }
 
  private:
   int x_;
@@ -30,6 +31,15 @@ namespace Utilities {
 
   static boost::lagged_fibonacci607 global_rng;
 
+  // A fixed pseudo-random number for each i, the same on every run.  Used for
+  // Zobrist hash keys.  This is the splitmix64 generator's mixing function.
+  inline uint64_t ZobristKey(uint64_t i) {
+    uint64_t z = (i + 1) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+  }
+
   template <typename Container>
   typename Container::value_type Sum(typename Container::const_iterator begin,
                                      typename Container::const_iterator end) {